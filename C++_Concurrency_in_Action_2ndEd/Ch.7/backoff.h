@@ -0,0 +1,55 @@
+#pragma once
+
+#include <thread>
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+// Contention management for CAS retry loops. A backoff policy is created at the start of a loop and pause() is called
+// after every failed attempt, so a stateful policy starts afresh for each operation:
+//     for (Backoff backoff;; backoff.pause()) { ... if (cas succeeded) break; }
+
+// Tells the core it is spinning: frees pipeline resources for the sibling hyper-thread and avoids the memory-order
+// mis-speculation penalty when the awaited cache line finally changes
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Retry immediately, the behaviour of the book's listings
+struct no_backoff {
+    void pause() {}
+};
+
+// Spins for a number of cpu_relax() that doubles after every failure, up to MaxSpins: threads that lost a CAS stay off
+// the contended cache line long enough for the winner to finish
+template < unsigned MaxSpins = 1024 >
+class exponential_backoff {
+    unsigned spins = 1;
+
+  public:
+    void pause() {
+        for (unsigned i = 0; i < spins; ++i) { cpu_relax(); }
+        if (spins < MaxSpins) { spins <<= 1; }
+    }
+};
+
+// Spins briefly, then gives the core away: for oversubscribed machines where the thread that has to make progress
+// may not be running
+template < unsigned SpinLimit = 16 >
+class spin_then_yield_backoff {
+    unsigned failures = 0;
+
+  public:
+    void pause() {
+        if (failures < SpinLimit) {
+            ++failures;
+            cpu_relax();
+        } else {
+            std::this_thread::yield();
+        }
+    }
+};
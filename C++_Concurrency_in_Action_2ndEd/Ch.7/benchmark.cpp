@@ -0,0 +1,346 @@
+#include "benchmark.h"
+#include "lockfree_bounded_queue.h"
+#include "lockfree_hash_map.h"
+#include "lockfree_priority_queue.h"
+#include "lockfree_queue.h"
+#include "lockfree_segmented_queue.h"
+#include "lockfree_stack.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <map>
+#include <optional>
+#include <queue>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// P producers push items_per_producer values each, P consumers pop until everything has been consumed
+template < class Queue >
+void bench_queue_mpmc(char const* name, unsigned pairs, std::size_t items_per_producer) {
+    Queue                      queue;
+    std::atomic< std::size_t > consumed { 0 };
+    std::size_t const          total = pairs * items_per_producer;
+
+    double const seconds = run_concurrently(2 * pairs, [&](unsigned index) {
+        if (index < pairs) {
+            for (std::size_t i = 0; i < items_per_producer; ++i) { queue.push(static_cast< int >(i)); }
+        } else {
+            int value;
+            while (consumed.load(std::memory_order::relaxed) < total) {
+                if (queue.try_pop(value)) {
+                    consumed.fetch_add(1, std::memory_order::relaxed);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    });
+    report(name, 2 * pairs, 2 * total, seconds);
+}
+
+// One producer hands items over to one consumer, batch == 0 means one call per item
+template < class Queue >
+void bench_queue_spsc(char const* name, std::size_t items, std::size_t batch) {
+    Queue queue;
+
+    double const seconds = run_concurrently(2, [&](unsigned index) {
+        if (index == 0) {
+            std::vector< int > values(batch ? batch : 1);
+            for (std::size_t pushed = 0; pushed < items;) {
+                std::size_t n;
+                if constexpr (requires { queue.push_n(values.begin(), batch); }) {
+                    n = batch ? queue.push_n(values.begin(), std::min(batch, items - pushed)) : queue.try_push(static_cast< int >(pushed));
+                } else {
+                    queue.push(static_cast< int >(pushed));
+                    n = 1;
+                }
+                if (!n) { std::this_thread::yield(); }
+                pushed += n;
+            }
+        } else {
+            std::vector< int > values(batch ? batch : 1);
+            for (std::size_t popped = 0; popped < items;) {
+                std::size_t n;
+                if constexpr (requires { queue.pop_n(values.begin(), batch); }) {
+                    n = batch ? queue.pop_n(values.begin(), batch) : queue.try_pop(values[0]);
+                } else {
+                    n = queue.pop() ? 1 : 0;
+                }
+                if (!n) { std::this_thread::yield(); }
+                popped += n;
+            }
+        }
+    });
+    report(name, 2, 2 * items, seconds);
+}
+
+// Every thread alternates push and pop, so the stack stays small and every operation hits head
+template < class Stack >
+void bench_stack_push_pop(char const* name, unsigned threads, std::size_t pairs_per_thread) {
+    Stack stack;
+
+    double const seconds = run_concurrently(threads, [&](unsigned) {
+        for (std::size_t i = 0; i < pairs_per_thread; ++i) {
+            stack.push(static_cast< int >(i));
+            stack.pop();
+        }
+    });
+    report(name, threads, 2 * threads * pairs_per_thread, seconds);
+}
+
+// Pop-heavy: the stack is filled up front, then every thread pops until it is empty, so every operation retires a node
+template < class Stack >
+void bench_stack_drain(char const* name, unsigned threads, std::size_t items_per_thread) {
+    Stack stack;
+    for (std::size_t i = 0; i < threads * items_per_thread; ++i) { stack.push(static_cast< int >(i)); }
+
+    double const seconds = run_concurrently(threads, [&](unsigned) {
+        while (stack.pop()) {}
+    });
+    report(name, threads, threads * items_per_thread, seconds);
+}
+
+// Producers hand items over to consumers through the stack, batch > 1 uses push_range() and pop_all()
+template < class Stack >
+void bench_stack_handoff(char const* name, unsigned pairs, std::size_t items_per_producer, std::size_t batch) {
+    Stack                      stack;
+    std::atomic< std::size_t > consumed { 0 };
+    std::size_t const          total = pairs * items_per_producer;
+
+    double const seconds = run_concurrently(2 * pairs, [&](unsigned index) {
+        if (index < pairs) {
+            std::vector< int > values(batch, static_cast< int >(index));
+            for (std::size_t pushed = 0; pushed < items_per_producer; pushed += batch) {
+                if (batch > 1) {
+                    stack.push_range(values.begin(), values.begin() + std::min(batch, items_per_producer - pushed));
+                } else {
+                    stack.push(values[0]);
+                }
+            }
+        } else {
+            while (consumed.load(std::memory_order::relaxed) < total) {
+                std::size_t const n = batch > 1 ? stack.pop_all().size() : (stack.pop() ? 1 : 0);
+                if (n) {
+                    consumed.fetch_add(n, std::memory_order::relaxed);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    });
+    report(name, 2 * pairs, 2 * total, seconds);
+}
+
+// The mutex-guarded std::unordered_map lock_free_hash_map is measured against
+template < class Key, class Value >
+class locked_hash_map {
+    mutable std::mutex                 mutex;
+    std::unordered_map< Key, Value > map;
+
+  public:
+    bool insert(Key const& key, Value const& value) {
+        std::lock_guard< std::mutex > lock(mutex);
+        return map.emplace(key, value).second;
+    }
+    bool erase(Key const& key) {
+        std::lock_guard< std::mutex > lock(mutex);
+        return map.erase(key) != 0;
+    }
+    std::optional< Value > find(Key const& key) const {
+        std::lock_guard< std::mutex > lock(mutex);
+        auto const                    it = map.find(key);
+        return it == map.end() ? std::nullopt : std::optional< Value >(it->second);
+    }
+};
+
+// The mutex-guarded std::map lock_free_skiplist is measured against
+template < class Key, class Value >
+class locked_ordered_map {
+    mutable std::mutex    mutex;
+    std::map< Key, Value > map;
+
+  public:
+    bool insert(Key const& key, Value const& value) {
+        std::lock_guard< std::mutex > lock(mutex);
+        return map.emplace(key, value).second;
+    }
+    bool erase(Key const& key) {
+        std::lock_guard< std::mutex > lock(mutex);
+        return map.erase(key) != 0;
+    }
+    std::optional< Value > find(Key const& key) const {
+        std::lock_guard< std::mutex > lock(mutex);
+        auto const                    it = map.find(key);
+        return it == map.end() ? std::nullopt : std::optional< Value >(it->second);
+    }
+};
+
+// The mutex-guarded std::priority_queue lock_free_priority_queue is measured against
+template < class Priority, class T >
+class locked_priority_queue {
+    using entry = std::pair< Priority, T >;
+    struct later {
+        bool operator()(entry const& a, entry const& b) const { return b.first < a.first; }
+    };
+    std::mutex                                                mutex;
+    std::priority_queue< entry, std::vector< entry >, later > queue;
+
+  public:
+    void push(Priority const& priority, T value) {
+        std::lock_guard< std::mutex > lock(mutex);
+        queue.emplace(priority, std::move(value));
+    }
+    std::optional< entry > delete_min() {
+        std::lock_guard< std::mutex > lock(mutex);
+        if (queue.empty()) { return std::nullopt; }
+        entry e = queue.top();
+        queue.pop();
+        return e;
+    }
+};
+
+// Random keys out of 2 * keys, half of them present at the start. A write is an insert or an erase with equal
+// probability, so the size stays around keys; reads_per_100 of every 100 operations are lookups.
+template < class Map >
+void bench_map(char const* name, unsigned threads, unsigned reads_per_100, std::size_t keys, std::size_t ops_per_thread) {
+    Map map;
+    for (std::size_t k = 0; k < 2 * keys; k += 2) { map.insert(static_cast< int >(k), static_cast< int >(k)); }
+
+    std::atomic< std::size_t > hits { 0 };
+    double const               seconds = run_concurrently(threads, [&](unsigned index) {
+        std::uint32_t state = 2654435761u * (index + 1); // xorshift32
+        std::size_t   found = 0;
+        for (std::size_t i = 0; i < ops_per_thread; ++i) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            int const      key  = static_cast< int >(state % (2 * keys));
+            unsigned const kind = (state >> 24) % 100;
+            if (kind < reads_per_100) {
+                found += map.find(key).has_value();
+            } else if (kind % 2) {
+                map.insert(key, key);
+            } else {
+                map.erase(key);
+            }
+        }
+        hits.fetch_add(found, std::memory_order::relaxed); // keeps the lookups
+    });
+    std::string const label = std::string(name) + " reads=" + std::to_string(reads_per_100) + "%";
+    report(label.c_str(), threads, threads * ops_per_thread, seconds);
+}
+
+// The queue holds about size entries: every thread alternates a push with a random priority and a delete_min
+template < class PriorityQueue >
+void bench_priority_queue(char const* name, unsigned threads, std::size_t size, std::size_t pairs_per_thread) {
+    PriorityQueue queue;
+    for (std::size_t i = 0; i < size; ++i) { queue.push(static_cast< int >(i * 2654435761u % size), 0); }
+
+    double const seconds = run_concurrently(threads, [&](unsigned index) {
+        std::uint32_t state = 2654435761u * (index + 1); // xorshift32
+        for (std::size_t i = 0; i < pairs_per_thread; ++i) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            queue.push(static_cast< int >(state % size), 0);
+            queue.delete_min();
+        }
+    });
+    report(name, threads, 2 * threads * pairs_per_thread, seconds);
+}
+
+// Every reclamation policy of reclaimer.h over the stack and, where it applies, the Michael-Scott queue.
+// leaking_reclaimer is left out: its memory grows with every pop.
+template < class Reclaimer >
+void bench_reclaimer(char const* reclaimer, std::size_t items) {
+    std::string const stack = std::string("lock_free_stack<") + reclaimer + ">";
+    for (unsigned threads : { 1u, 4u }) {
+        bench_stack_push_pop< lock_free_stack< int, Reclaimer, new_delete_node_allocator > >((stack + " new/delete").c_str(), threads, items);
+        bench_stack_push_pop< lock_free_stack< int, Reclaimer, pooled_node_allocator > >((stack + " pooled").c_str(), threads, items);
+        bench_stack_drain< lock_free_stack< int, Reclaimer > >((stack + " drain").c_str(), threads, items);
+    }
+    bench_stack_handoff< lock_free_stack< int, Reclaimer > >((stack + " push/pop").c_str(), 2, items, 1);
+    bench_stack_handoff< lock_free_stack< int, Reclaimer > >((stack + " push_range/pop_all(64)").c_str(), 2, items, 64);
+    if constexpr (Reclaimer::protect_slots >= 2 && Reclaimer::keeps_retired_links) {
+        std::string const queue = std::string("lock_free_queue_MS<") + reclaimer + ">";
+        for (unsigned pairs : { 1u, 2u, 4u }) { bench_queue_mpmc< lock_free_queue_MS< int, Reclaimer > >(queue.c_str(), pairs, items); }
+    }
+}
+
+// Throughput against thread count for one backoff policy, on the structures whose CAS loops contend on one word
+template < class Backoff >
+void bench_backoff(char const* backoff, std::size_t items) {
+    std::string const stack = std::string("lock_free_stack_epoch backoff=") + backoff;
+    std::string const queue = std::string("lock_free_queue_RC_tail_modified backoff=") + backoff;
+    for (unsigned threads : { 1u, 2u, 4u, 8u, 16u }) {
+        bench_stack_push_pop< lock_free_stack_epoch< int, default_node_allocator, Backoff > >(stack.c_str(), threads, items);
+    }
+    for (unsigned pairs : { 1u, 2u, 4u, 8u }) {
+        bench_queue_mpmc< lock_free_queue_RC_tail_modified< int, default_node_allocator, Backoff > >(queue.c_str(), pairs, items);
+    }
+}
+
+// The split reference count containers with the counted pointer in two words and packed into one
+template < class CountedPtr >
+void bench_counted_ptr(char const* layout, std::size_t items) {
+    std::string const stack = std::string("lock_free_stack_7_11 ") + layout;
+    std::string const queue = std::string("lock_free_queue_RC_tail_modified ") + layout;
+    for (unsigned threads : { 1u, 4u }) {
+        bench_stack_push_pop< lock_free_stack< int, basic_split_ref_count_reclaimer< CountedPtr > > >(stack.c_str(), threads, items);
+    }
+    for (unsigned pairs : { 1u, 2u, 4u }) {
+        bench_queue_mpmc< lock_free_queue_RC_tail_modified< int, default_node_allocator, no_backoff, CountedPtr > >(queue.c_str(), pairs, items);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::size_t const items = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1'000'000;
+
+    for (unsigned pairs : { 1u, 2u, 4u }) {
+        bench_queue_mpmc< lock_free_queue_RC_tail_modified< int > >("lock_free_queue_RC_tail_modified", pairs, items);
+        bench_queue_mpmc< lock_free_queue_bounded_MPMC< int > >("lock_free_queue_bounded_MPMC", pairs, items);
+        bench_queue_mpmc< lock_free_queue_segmented< int > >("lock_free_queue_segmented", pairs, items);
+        bench_queue_mpmc< lock_free_queue_MS_epoch< int > >("lock_free_queue_MS_epoch", pairs, items);
+    }
+    bench_queue_mpmc< lock_free_queue_RC_tail_modified< int, new_delete_node_allocator > >("lock_free_queue_RC_tail_modified new/delete", 2, items);
+    bench_queue_mpmc< lock_free_queue_RC_tail_inline< int > >("lock_free_queue_RC_tail_inline", 2, items);
+
+    bench_reclaimer< threads_in_pop_reclaimer >("threads_in_pop", items);
+    bench_reclaimer< hazard_pointer_reclaimer >("hazard_pointer", items);
+    bench_reclaimer< split_ref_count_reclaimer >("split_ref_count", items);
+    bench_reclaimer< hazard_domain_reclaimer >("hazard_domain", items);
+    bench_reclaimer< epoch_reclaimer >("epoch", items);
+    for (unsigned threads : { 1u, 4u }) { bench_stack_push_pop< lock_free_stack_inline< int > >("lock_free_stack_inline", threads, items); }
+
+    for (unsigned threads : { 1u, 2u, 4u, 8u, 16u }) {
+        bench_stack_push_pop< lock_free_stack_epoch< int > >("lock_free_stack_epoch", threads, items);
+        bench_stack_push_pop< lock_free_stack_elimination< int > >("lock_free_stack_elimination", threads, items);
+    }
+
+    bench_counted_ptr< wide_counted_ptr >("wide", items);
+    if constexpr (packed_counted_ptr::supported) { bench_counted_ptr< packed_counted_ptr >("packed", items); }
+
+    bench_backoff< no_backoff >("none", items);
+    bench_backoff< exponential_backoff<> >("exponential", items);
+    bench_backoff< spin_then_yield_backoff<> >("spin_then_yield", items);
+
+    for (unsigned reads : { 100u, 90u, 50u }) {
+        for (unsigned threads : { 1u, 4u, 16u }) {
+            bench_map< lock_free_hash_map< int, int > >("lock_free_hash_map", threads, reads, 1 << 16, items);
+            bench_map< locked_hash_map< int, int > >("std::unordered_map + std::mutex", threads, reads, 1 << 16, items);
+            bench_map< lock_free_skiplist< int, int > >("lock_free_skiplist", threads, reads, 1 << 16, items);
+            bench_map< locked_ordered_map< int, int > >("std::map + std::mutex", threads, reads, 1 << 16, items);
+        }
+    }
+
+    for (unsigned threads : { 1u, 4u, 16u }) {
+        bench_priority_queue< lock_free_priority_queue< int, int > >("lock_free_priority_queue", threads, 1 << 12, items);
+        bench_priority_queue< locked_priority_queue< int, int > >("std::priority_queue + std::mutex", threads, 1 << 12, items);
+    }
+
+    bench_queue_spsc< lock_free_queue_7_13_SPSC< int > >("lock_free_queue_7_13_SPSC", items, 0);
+    bench_queue_spsc< lock_free_queue_ring_SPSC< int > >("lock_free_queue_ring_SPSC", items, 0);
+    bench_queue_spsc< lock_free_queue_ring_SPSC< int > >("lock_free_queue_ring_SPSC push_n/pop_n(64)", items, 64);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "lockfree_stats.h"
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Runs body(thread_index) on thread_count threads released together, returns the wall time in seconds
+template < class Body >
+double run_concurrently(unsigned thread_count, Body body) {
+    std::atomic< unsigned >    ready { 0 };
+    std::atomic< bool >        go { false };
+    std::vector< std::thread > threads;
+    threads.reserve(thread_count);
+
+    for (unsigned i = 0; i < thread_count; ++i) {
+        threads.emplace_back([&, i] {
+            ready.fetch_add(1);
+            while (!go.load()) { std::this_thread::yield(); }
+            body(i);
+        });
+    }
+    while (ready.load() != thread_count) { std::this_thread::yield(); }
+
+    auto const start = std::chrono::steady_clock::now();
+    go.store(true);
+    for (auto& t : threads) { t.join(); }
+    return std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+}
+
+// With LOCKFREE_STATS, also prints the counters that moved since the previous report
+inline void report(char const* name, unsigned threads, std::size_t operations, double seconds) {
+    std::printf("%-56s threads=%-3u ops=%-10zu %8.3f Mops/s\n", name, threads, operations, operations / seconds / 1e6);
+    if constexpr (lockfree_stats_enabled) {
+        static lockfree_stats::snapshot last;
+        lockfree_stats::snapshot const  now = lockfree_stats::take_snapshot();
+        bool                            any = false;
+        for (unsigned e = 0; e < lockfree_stats::event_count; ++e) {
+            if (now.values[e] == last.values[e]) { continue; }
+            std::printf("%s %s=%llu", any ? "" : "   ", lockfree_stats::name(lockfree_stats::event(e)),
+                        static_cast< unsigned long long >(now.values[e] - last.values[e]));
+            any = true;
+        }
+        if (any) { std::printf("\n"); }
+        last = now;
+    }
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstddef>
+
+// Alignment used to keep atomics written by different threads on separate cache lines (avoids false sharing).
+// std::hardware_destructive_interference_size is not used since it is not ABI-stable across compilers yet.
+inline constexpr std::size_t cache_line_size = 64;
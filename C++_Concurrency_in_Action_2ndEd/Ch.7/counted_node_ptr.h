@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+// Representations of the counted pointer of the split reference count scheme (listings 7.10 to 7.21): a node pointer
+// and the external count of the references taken through it, read and replaced together by one compare_exchange.
+// A representation R provides R::type< Node > with
+//     type();                                           null pointer, count 0
+//     type(std::intptr_t external_count, Node* ptr);
+//     Node* ptr() const;                                void set_ptr(Node*);
+//     std::intptr_t external_count() const;             void set_external_count(std::intptr_t);
+
+// Count and pointer side by side, as in the listings: 16 bytes on 64-bit targets. std::atomic of it is lock-free only
+// where the compiler inlines a double-width CAS (cmpxchg16b), otherwise libatomic may fall back to a lock.
+struct wide_counted_ptr {
+    template < class Node >
+    class type {
+        std::intptr_t count; // pointer-sized, so the struct has no padding bytes for compare_exchange to compare
+        Node*         pointer;
+
+      public:
+        type() : count(0), pointer(nullptr) {}
+        type(std::intptr_t external_count, Node* ptr) : count(external_count), pointer(ptr) {}
+
+        Node*         ptr() const { return pointer; }
+        std::intptr_t external_count() const { return count; }
+        void          set_ptr(Node* ptr) { pointer = ptr; }
+        void          set_external_count(std::intptr_t external_count) { count = external_count; }
+    };
+};
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__aarch64__) || defined(_M_ARM64)
+inline constexpr bool pointers_have_spare_high_bits = sizeof(void*) == 8;
+#else
+inline constexpr bool pointers_have_spare_high_bits = false;
+#endif
+
+// Count in the upper 16 bits of a single 64-bit word: user-space addresses on x86-64 and AArch64 fit in 48 bits,
+// unless a 57-bit address space is explicitly requested from the kernel, so the CAS is a plain cmpxchg.
+// The count wraps at 65536: the containers give a reference back in place while the pointer is still installed,
+// which keeps the count bounded by the number of threads holding a reference at the same time.
+struct packed_counted_ptr {
+    inline static bool const supported = pointers_have_spare_high_bits;
+
+    template < class Node >
+    class type {
+        static_assert(supported, "the target has no unused pointer bits to hold the count");
+
+        inline static unsigned const       count_shift  = 48;
+        inline static std::uintptr_t const pointer_mask = (std::uintptr_t(1) << count_shift) - 1;
+
+        std::uintptr_t bits;
+
+      public:
+        type() : bits(0) {}
+        type(std::intptr_t external_count, Node* ptr) : bits((std::uintptr_t(external_count) << count_shift) | reinterpret_cast< std::uintptr_t >(ptr)) {}
+
+        Node*         ptr() const { return reinterpret_cast< Node* >(bits & pointer_mask); }
+        std::intptr_t external_count() const { return static_cast< std::intptr_t >(bits >> count_shift); }
+        void          set_ptr(Node* ptr) { bits = (bits & ~pointer_mask) | reinterpret_cast< std::uintptr_t >(ptr); }
+        void          set_external_count(std::intptr_t external_count) { bits = (bits & pointer_mask) | (std::uintptr_t(external_count) << count_shift); }
+    };
+};
+
+// The listings' layout when the target has a lock-free double-width CAS for it, the packed word otherwise
+using default_counted_ptr = std::conditional_t< std::atomic< wide_counted_ptr::type< void > >::is_always_lock_free || !packed_counted_ptr::supported,
+                                                wide_counted_ptr, packed_counted_ptr >;
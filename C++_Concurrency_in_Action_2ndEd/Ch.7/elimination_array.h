@@ -0,0 +1,73 @@
+#pragma once
+
+#include "backoff.h"
+#include "cache_line.h"
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+// Elimination array: a thread whose push lost the CAS on head posts its value in a random slot and waits there a
+// little while, a pop that lost the CAS looks into a random slot and takes the value it finds. Both operations then
+// complete without touching head: the pair behaves as a push immediately followed by a pop.
+// The offer lives on the stack of the pushing thread, which does not leave before a taker has read it.
+// see more about the technique: Danny Hendler, Nir Shavit and Lena Yerushalmi, A scalable lock-free stack
+// algorithm, 2004
+template < class Value, unsigned Slots = 8 >
+class elimination_array {
+    static_assert(Slots > 0);
+
+  public:
+    inline static unsigned const patience = 128; // cpu_relax() an offer waits for a taker before being withdrawn
+
+  private:
+    struct offer_record {
+        Value*              value;
+        std::atomic< bool > done;
+    };
+    struct alignas(cache_line_size) slot {
+        std::atomic< offer_record* > record;
+    };
+    slot slots[Slots];
+
+    // xorshift32, one generator per thread so that colliding threads spread over different slots
+    static unsigned random_slot() {
+        thread_local std::uint32_t state = static_cast< std::uint32_t >(std::hash< std::thread::id > {}(std::this_thread::get_id())) | 1;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state % Slots;
+    }
+
+  public:
+    elimination_array() = default;
+
+    elimination_array(const elimination_array&) = delete;
+    elimination_array operator=(const elimination_array&) = delete;
+
+    // true if a taker got value, false if nobody came and value is still owned by the caller
+    bool offer(Value* value) {
+        slot&         s = slots[random_slot()];
+        offer_record  record { value, false };
+        offer_record* expected = nullptr;
+        if (!s.record.compare_exchange_strong(expected, &record, std::memory_order::release, std::memory_order::relaxed)) { return false; }
+        for (unsigned i = 0; i < patience; ++i) {
+            if (record.done.load(std::memory_order::acquire)) { return true; }
+            cpu_relax();
+        }
+        expected = &record;
+        if (s.record.compare_exchange_strong(expected, nullptr, std::memory_order::relaxed)) { return false; }
+        while (!record.done.load(std::memory_order::acquire)) { cpu_relax(); } // claimed: wait until the taker read it
+        return true;
+    }
+
+    // A value offered by another thread, nullptr if the chosen slot holds none
+    Value* take() {
+        slot&         s      = slots[random_slot()];
+        offer_record* record = s.record.load(std::memory_order::relaxed);
+        if (!record || !s.record.compare_exchange_strong(record, nullptr, std::memory_order::acquire, std::memory_order::relaxed)) { return nullptr; }
+        Value* const value = record->value;
+        record->done.store(true, std::memory_order::release); // record may disappear from here on
+        return value;
+    }
+};
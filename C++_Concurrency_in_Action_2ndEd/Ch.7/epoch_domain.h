@@ -0,0 +1,203 @@
+#pragma once
+
+#include "cache_line.h"
+#include "lockfree_stats.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Epoch-based reclamation: a thread announces the global epoch when it enters a critical section and clears the
+// announcement when it leaves. A node retired during epoch e can be freed once the global epoch reaches e + 2,
+// since every thread that was inside a critical section when the node was unlinked has left it by then.
+// Entering and leaving are a store to the thread's own cache line; the cost is that one thread stalled inside a
+// critical section stops reclamation for everybody.
+// see more about the technique: Keir Fraser, Practical lock-freedom, 2004
+class epoch_domain {
+  public:
+    inline static std::size_t const advance_threshold = 64; // retirements between two attempts to advance the epoch
+
+  private:
+    struct alignas(cache_line_size) thread_slot {
+        std::atomic< bool >          owned;
+        std::atomic< std::uint64_t > state; // (announced epoch << 1) | 1 while inside a critical section, 0 outside
+        thread_slot*                 next;  // set before the slot is published, never changed after
+    };
+
+    // One slot per thread with a record, kept like the records of hazard_pointer_registry: pushed on a lock-free list
+    // and never unlinked, a slot left by an exited thread goes to the next new thread. The list is as long as the most
+    // threads ever alive at once, and that is all try_advance() scans.
+    class slot_list {
+        std::atomic< thread_slot* > head;
+
+      public:
+        slot_list() : head(nullptr) {}
+        ~slot_list() {
+            for (thread_slot* s = head.load(std::memory_order::relaxed); s;) {
+                thread_slot* const next = s->next;
+                delete s;
+                s = next;
+            }
+        }
+
+        slot_list(slot_list const&) = delete;
+        slot_list operator=(slot_list const&) = delete;
+
+        thread_slot* first() const { return head.load(); }
+
+        // Claims a slot nobody owns, or appends a new one: never fails
+        thread_slot* acquire() {
+            for (thread_slot* s = first(); s; s = s->next) {
+                bool expected = false;
+                if (!s->owned.load(std::memory_order::relaxed) && s->owned.compare_exchange_strong(expected, true, std::memory_order::acquire)) {
+                    return s;
+                }
+            }
+            thread_slot* const s = new thread_slot;
+            s->owned.store(true, std::memory_order::relaxed);
+            s->state.store(0, std::memory_order::relaxed);
+            s->next = head.load(std::memory_order::relaxed);
+            // seq_cst like the loads of try_advance(): a scan that misses the slot precedes its first announcement
+            while (!head.compare_exchange_weak(s->next, s))
+                ;
+            return s;
+        }
+
+        void release(thread_slot* s) { s->owned.store(false, std::memory_order::release); }
+    };
+    inline static slot_list slots;
+
+    // 64 bits: the epoch never wraps, and the shift of the announcement never drops a bit of it
+    alignas(cache_line_size) inline static std::atomic< std::uint64_t > global_epoch;
+
+    struct retired_node {
+        void* data;
+        void (*deleter)(void*);
+    };
+
+    // Nodes left by exited threads, adopted by the next thread that advances the epoch
+    struct orphan_batch {
+        std::vector< retired_node > nodes;
+        orphan_batch*               next;
+    };
+    inline static std::atomic< orphan_batch* > orphans { nullptr };
+
+    static void free_nodes(std::vector< retired_node >& nodes) {
+        for (retired_node const& n : nodes) { n.deleter(n.data); }
+        lockfree_stats::add(lockfree_stats::reclaimed, nodes.size());
+        nodes.clear();
+    }
+
+    struct thread_record {
+        thread_slot* slot;
+        unsigned     nesting = 0;
+        std::size_t  retired_since_advance = 0;
+        // one list per epoch still in flight, list i holds nodes retired during limbo_epoch[i]
+        std::vector< retired_node > limbo[3];
+        std::uint64_t               limbo_epoch[3] = {};
+
+        thread_record() : slot(slots.acquire()) {}
+        thread_record(thread_record const&) = delete;
+        thread_record operator=(thread_record const&) = delete;
+
+        ~thread_record() {
+            for (int attempt = 0; attempt < 3; ++attempt) { try_advance(*this); }
+            std::vector< retired_node > rest;
+            for (auto& list : limbo) {
+                rest.insert(rest.end(), list.begin(), list.end());
+                list.clear();
+            }
+            if (!rest.empty()) {
+                orphan_batch* const batch = new orphan_batch { std::move(rest), orphans.load() };
+                while (!orphans.compare_exchange_weak(batch->next, batch))
+                    ;
+            }
+            slots.release(slot);
+        }
+
+        // Frees the lists retired at least two epochs before current
+        void free_expired(std::uint64_t current) {
+            for (unsigned i = 0; i < 3; ++i) {
+                if (!limbo[i].empty() && current - limbo_epoch[i] >= 2) { free_nodes(limbo[i]); }
+            }
+        }
+    };
+
+    static thread_record& local_record() {
+        thread_local thread_record record;
+        return record;
+    }
+
+    // The epoch moves from e to e + 1 once every thread inside a critical section has announced e
+    static void try_advance(thread_record& record) {
+        record.retired_since_advance = 0;
+        std::uint64_t const current  = global_epoch.load();
+        for (thread_slot* s = slots.first(); s; s = s->next) {
+            std::uint64_t const state = s->state.load();
+            if ((state & 1) && (state >> 1) != current) {
+                record.free_expired(current);
+                return;
+            }
+        }
+        std::uint64_t expected = current;
+        if (global_epoch.compare_exchange_strong(expected, current + 1)) { lockfree_stats::add(lockfree_stats::epoch_advances); }
+        record.free_expired(expected == current ? current + 1 : expected);
+
+        for (orphan_batch* batch = orphans.exchange(nullptr); batch;) {
+            retire_all(record, batch->nodes); // re-retired in the current epoch: later than their own, so still safe
+            orphan_batch* const next = batch->next;
+            delete batch;
+            batch = next;
+        }
+    }
+
+    static std::vector< retired_node >& current_list(thread_record& record) {
+        std::uint64_t const current = global_epoch.load();
+        std::size_t const   index   = current % 3;
+        if (record.limbo_epoch[index] != current) {
+            free_nodes(record.limbo[index]); // retired three or more epochs ago
+            record.limbo_epoch[index] = current;
+        }
+        return record.limbo[index];
+    }
+
+    static void retire_all(thread_record& record, std::vector< retired_node > const& nodes) {
+        std::vector< retired_node >& list = current_list(record);
+        list.insert(list.end(), nodes.begin(), nodes.end());
+    }
+
+    template < class Allocator, class Node >
+    static void destroy_node(void* p) {
+        Allocator::destroy(static_cast< Node* >(p));
+    }
+
+  public:
+    // Critical section: pointers loaded from the structure stay valid until the guard is destroyed. Guards nest.
+    class guard {
+        thread_record& record;
+
+      public:
+        guard() : record(local_record()) {
+            if (record.nesting++) { return; }
+            record.slot->state.store((global_epoch.load() << 1) | 1, std::memory_order::relaxed);
+            std::atomic_thread_fence(std::memory_order::seq_cst); // the announcement is visible before any load of a node
+        }
+        ~guard() {
+            if (--record.nesting) { return; }
+            record.slot->state.store(0, std::memory_order::release);
+        }
+
+        guard(guard const&) = delete;
+        guard operator=(guard const&) = delete;
+    };
+
+    // node must already be unreachable for threads entering a critical section from now on
+    template < class Allocator, class Node >
+    static void retire(Node* node) {
+        thread_record& record = local_record();
+        current_list(record).push_back({ node, &destroy_node< Allocator, Node > });
+        lockfree_stats::add(lockfree_stats::retired);
+        if (++record.retired_since_advance >= advance_threshold) { try_advance(record); }
+    }
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "backoff.h"
+#include "cache_line.h"
+#include <atomic>
+
+// Eventcount: lets consumers of a lock-free structure sleep while it is empty, without adding anything to the
+// producer's fast path beyond a fence and one load when nobody sleeps. A consumer announces itself, reads the key,
+// checks the structure once more and only then blocks on the key. The fences make a producer see the announcement or
+// the consumer see the change; a consumer whose key already carries a notification sees the change through the
+// release/acquire pair on epoch, and a notification after the key makes wait() return at once.
+// Blocking is std::atomic::wait on a 32-bit counter, a futex on Linux.
+//     consumer: events.await([&] { return done || queue.try_pop(item); });
+//     producer: queue.push(item); events.notify_one();
+// see more about the technique: Dmitry Vyukov, eventcount, 2008
+class event_count {
+  public:
+    inline static unsigned const spin_limit = 64; // checks before going to sleep, a wake-up costs a few microseconds
+
+  private:
+    alignas(cache_line_size) std::atomic< unsigned > epoch;   // bumped by every notification that may wake someone
+    alignas(cache_line_size) std::atomic< unsigned > waiters; // threads between prepare_wait() and the end of wait()
+
+  public:
+    event_count() : epoch(0), waiters(0) {}
+
+    event_count(const event_count&) = delete;
+    event_count operator=(const event_count&) = delete;
+
+    // Announces the caller as a waiter, the condition must be checked again before calling wait() with the key
+    unsigned prepare_wait() {
+        waiters.fetch_add(1, std::memory_order::relaxed);
+        std::atomic_thread_fence(std::memory_order::seq_cst); // the announcement is visible before the condition is read
+        return epoch.load(std::memory_order::acquire); // a key bumped by a notifier comes with the change it notified
+    }
+    void cancel_wait() { waiters.fetch_sub(1, std::memory_order::relaxed); }
+
+    // Blocks until a notification issued after prepare_wait()
+    void wait(unsigned key) {
+        epoch.wait(key, std::memory_order::relaxed);
+        waiters.fetch_sub(1, std::memory_order::relaxed);
+    }
+
+    // Call after making the condition true
+    void notify_one() {
+        std::atomic_thread_fence(std::memory_order::seq_cst); // the change of the condition is visible before waiters is read
+        if (!waiters.load(std::memory_order::relaxed)) { return; }
+        epoch.fetch_add(1, std::memory_order::release);
+        epoch.notify_one();
+    }
+    void notify_all() {
+        std::atomic_thread_fence(std::memory_order::seq_cst);
+        if (!waiters.load(std::memory_order::relaxed)) { return; }
+        epoch.fetch_add(1, std::memory_order::release);
+        epoch.notify_all();
+    }
+
+    // Returns once ready() returned true: ready() is polled spins times, then between sleeps
+    template < class Predicate >
+    void await(Predicate ready, unsigned spins = spin_limit) {
+        for (unsigned i = 0; i < spins; ++i) {
+            if (ready()) { return; }
+            cpu_relax();
+        }
+        for (;;) {
+            unsigned const key = prepare_wait();
+            if (ready()) {
+                cancel_wait();
+                return;
+            }
+            wait(key);
+            if (ready()) { return; }
+        }
+    }
+};
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "hazard_pointer_registry.h"
+#include "lockfree_stats.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Hazard pointers with per-thread retire lists, an amortized alternative to the machinery of listing 7.7
+// - a thread keeps the slots it used once and reuses them, claiming a slot is a thread-local operation
+// - retire() appends to a thread-local list, nothing is scanned until the list reaches reclaim_threshold
+// - a scan loads every slot in use once into a sorted snapshot, then looks each retired node up with a binary search
+// With a threshold of twice the slots of the registry at least half of the scanned nodes are freed, so one scan of the
+// H slots is paid for by as many retired nodes: O(log(H)) amortized work per node.
+// This technique is patented by IBM, and can only be used under GPL or with a licensing arrangement
+class hazard_pointer_domain {
+  public:
+    inline static std::size_t const min_reclaim_threshold = 64;
+
+    // Retired nodes a thread keeps before scanning, grows with the slots ever claimed at once
+    static std::size_t reclaim_threshold() { return std::max(min_reclaim_threshold, 2 * slots.size()); }
+
+  private:
+    using hazard_slot = hazard_pointer_registry::record;
+    inline static hazard_pointer_registry slots;
+
+    struct retired_node {
+        void* data;
+        void (*deleter)(void*);
+    };
+
+    // Retired nodes still hazardous when their thread exits, adopted by the next scan of any thread
+    struct orphan_batch {
+        std::vector< retired_node > nodes;
+        orphan_batch*               next;
+    };
+    inline static std::atomic< orphan_batch* > orphans { nullptr };
+
+    struct thread_record {
+        inline static unsigned const max_idle_slots = 4;
+
+        hazard_slot*                idle_slots[max_idle_slots];
+        unsigned                    idle_count = 0;
+        std::vector< retired_node > retired;
+        std::vector< void* >        hazards; // snapshot buffer, kept to avoid an allocation per scan
+
+        thread_record() {
+            retired.reserve(min_reclaim_threshold);
+            hazards.reserve(min_reclaim_threshold);
+        }
+        thread_record(thread_record const&) = delete;
+        thread_record operator=(thread_record const&) = delete;
+
+        ~thread_record() {
+            scan(*this);
+            if (!retired.empty()) {
+                orphan_batch* const batch = new orphan_batch { std::move(retired), orphans.load() };
+                while (!orphans.compare_exchange_weak(batch->next, batch))
+                    ;
+            }
+            while (idle_count) { slots.release(idle_slots[--idle_count]); }
+        }
+    };
+
+    static thread_record& local_record() {
+        thread_local thread_record record;
+        return record;
+    }
+
+    static hazard_slot* acquire_slot() {
+        thread_record& record = local_record();
+        if (record.idle_count) { return record.idle_slots[--record.idle_count]; }
+        return slots.acquire();
+    }
+
+    static void release_slot(hazard_slot* slot) {
+        slot->pointer.store(nullptr, std::memory_order::release);
+        thread_record& record = local_record();
+        if (record.idle_count < thread_record::max_idle_slots) {
+            record.idle_slots[record.idle_count++] = slot;
+        } else {
+            slots.release(slot);
+        }
+    }
+
+    static void scan(thread_record& record) {
+        for (orphan_batch* batch = orphans.exchange(nullptr); batch;) {
+            record.retired.insert(record.retired.end(), batch->nodes.begin(), batch->nodes.end());
+            orphan_batch* const next = batch->next;
+            delete batch;
+            batch = next;
+        }
+
+        lockfree_stats::add(lockfree_stats::hazard_scans);
+        record.hazards.clear();
+        slots.for_each_hazard([&](void* p) { record.hazards.push_back(p); });
+        std::sort(record.hazards.begin(), record.hazards.end());
+
+        auto const still_hazardous = std::partition(record.retired.begin(), record.retired.end(), [&](retired_node const& n) {
+            return std::binary_search(record.hazards.begin(), record.hazards.end(), n.data);
+        });
+        for (auto it = still_hazardous; it != record.retired.end(); ++it) { it->deleter(it->data); }
+        lockfree_stats::add(lockfree_stats::reclaimed, static_cast< std::uint64_t >(record.retired.end() - still_hazardous));
+        record.retired.erase(still_hazardous, record.retired.end());
+    }
+
+    template < class Allocator, class Node >
+    static void destroy_node(void* p) {
+        Allocator::destroy(static_cast< Node* >(p));
+    }
+
+  public:
+    // Owns one hazard slot for its lifetime, protect() publishes a pointer before the caller dereferences it
+    class guard {
+        hazard_slot* slot;
+
+      public:
+        guard() : slot(acquire_slot()) {}
+        ~guard() { release_slot(slot); }
+
+        guard(guard const&) = delete;
+        guard operator=(guard const&) = delete;
+
+        // Publishes seen, a value loaded from src, and reloads src until the value read is the one published,
+        // see listing 7.6
+        template < class U >
+        U* protect(std::atomic< U* > const& src, U* seen) {
+            for (;;) {
+                slot->pointer.store(seen);
+                U* const current = src.load();
+                if (current == seen) { return seen; }
+                seen = current;
+            }
+        }
+        template < class U >
+        U* protect(std::atomic< U* > const& src) {
+            return protect(src, src.load(std::memory_order::relaxed));
+        }
+
+        void reset() { slot->pointer.store(nullptr, std::memory_order::release); }
+    };
+
+    // node must already be unreachable for threads that have not protected it yet
+    template < class Allocator, class Node >
+    static void retire(Node* node) {
+        thread_record& record = local_record();
+        record.retired.push_back({ node, &destroy_node< Allocator, Node > });
+        lockfree_stats::add(lockfree_stats::retired);
+        if (record.retired.size() >= reclaim_threshold()) { scan(record); }
+    }
+
+    // Frees every node retired by the calling thread that is not protected anymore
+    static void reclaim() { scan(local_record()); }
+};
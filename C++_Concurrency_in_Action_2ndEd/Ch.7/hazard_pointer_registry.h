@@ -0,0 +1,81 @@
+#pragma once
+
+#include "cache_line.h"
+#include "lockfree_stats.h"
+#include <atomic>
+#include <cstddef>
+
+// Growable set of hazard pointers, used by the machinery of listing 7.7 and by hazard_pointer_domain
+// - one record per hazard pointer, each on its own cache line; a thread owns as many records as it needs pointers
+// - records are pushed on a lock-free list and never unlinked, a record released by a thread is reused by the next
+//   acquire() of any thread, so the list is as long as the most hazard pointers ever held at once
+// - scans skip the records nobody owns
+// stack_7_6_model in model_check.cpp restates acquire(), release() and contains(): keep both in sync
+// see more about the technique: Maged M. Michael, Hazard Pointers: Safe Memory Reclamation for Lock-Free Objects, 2004
+class hazard_pointer_registry {
+  public:
+    struct alignas(cache_line_size) record {
+        std::atomic< bool >  active;
+        std::atomic< void* > pointer;
+        record*              next; // set before the record is published, never changed after
+    };
+
+  private:
+    std::atomic< record* >     head { nullptr };
+    std::atomic< std::size_t > records { 0 };
+
+  public:
+    hazard_pointer_registry() = default;
+    ~hazard_pointer_registry() {
+        for (record* r = head.load(std::memory_order::relaxed); r;) {
+            record* const next = r->next;
+            delete r;
+            r = next;
+        }
+    }
+
+    hazard_pointer_registry(hazard_pointer_registry const&) = delete;
+    hazard_pointer_registry operator=(hazard_pointer_registry const&) = delete;
+
+    // Claims a record nobody owns, or appends a new one: never fails
+    record* acquire() {
+        for (record* r = head.load(std::memory_order::acquire); r; r = r->next) {
+            lockfree_stats::add(lockfree_stats::hp_owner_probes);
+            bool expected = false;
+            if (!r->active.load(std::memory_order::relaxed) && r->active.compare_exchange_strong(expected, true)) { return r; }
+        }
+        record* const r = new record;
+        r->active.store(true, std::memory_order::relaxed);
+        r->next = head.load(std::memory_order::relaxed);
+        // seq_cst, like the claim above: a scan that starts after the owner has published a pointer in the record sees it
+        while (!head.compare_exchange_weak(r->next, r))
+            ;
+        records.fetch_add(1, std::memory_order::relaxed);
+        return r;
+    }
+
+    void release(record* r) {
+        r->pointer.store(nullptr, std::memory_order::release);
+        r->active.store(false, std::memory_order::release);
+    }
+
+    // Calls f with every pointer published in an owned record. The loads are seq_cst, like the stores of protect(): a
+    // reader either sees the node unlinked when it loads its source again, or has its pointer seen here
+    template < class Function >
+    void for_each_hazard(Function f) const {
+        for (record* r = head.load(); r; r = r->next) {
+            if (!r->active.load()) { continue; }
+            if (void* const p = r->pointer.load()) { f(p); }
+        }
+    }
+
+    bool contains(void* p) const {
+        for (record* r = head.load(); r; r = r->next) {
+            if (r->active.load() && r->pointer.load() == p) { return true; }
+        }
+        return false;
+    }
+
+    // Records allocated so far, owned or not
+    std::size_t size() const { return records.load(std::memory_order::relaxed); }
+};
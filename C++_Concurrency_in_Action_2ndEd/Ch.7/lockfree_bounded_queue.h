@@ -0,0 +1,244 @@
+#pragma once
+
+#include "cache_line.h"
+#include "lockfree_stats.h"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// Bounded multi-producer, multi-consumer queue over a ring of cells with per-cell sequence numbers
+// see more about the technique: Dmitry Vyukov, Bounded MPMC queue, https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+// Values are stored in place: no allocation after construction, one CAS per push and per pop
+template < class T >
+class alignas(cache_line_size) lock_free_queue_bounded_MPMC {
+    static_assert(std::is_nothrow_move_constructible_v< T >, "a claimed cell must always be published");
+    static_assert(std::is_nothrow_move_assignable_v< T >, "a claimed cell must always be released");
+
+  private:
+    struct cell {
+        std::atomic< std::size_t > sequence;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        T* value() { return std::launder(reinterpret_cast< T* >(storage)); }
+    };
+
+    static std::size_t round_up_to_power_of_2(std::size_t capacity) {
+        std::size_t result = 2;
+        while (result < capacity) { result <<= 1; }
+        return result;
+    }
+
+    std::size_t const mask;
+    cell* const       buffer;
+
+    alignas(cache_line_size) std::atomic< std::size_t > enqueue_pos;
+    alignas(cache_line_size) std::atomic< std::size_t > dequeue_pos;
+
+  public:
+    inline static std::size_t const default_capacity = 4096;
+
+    explicit lock_free_queue_bounded_MPMC(std::size_t capacity = default_capacity) :
+        mask(round_up_to_power_of_2(capacity) - 1), buffer(new cell[mask + 1]), enqueue_pos(0), dequeue_pos(0) {
+        for (std::size_t i = 0; i <= mask; ++i) { buffer[i].sequence.store(i, std::memory_order::relaxed); }
+    }
+
+    lock_free_queue_bounded_MPMC(const lock_free_queue_bounded_MPMC&) = delete;
+    lock_free_queue_bounded_MPMC operator=(const lock_free_queue_bounded_MPMC&) = delete;
+
+    ~lock_free_queue_bounded_MPMC() {
+        for (std::size_t pos = dequeue_pos.load(); pos != enqueue_pos.load(); ++pos) { buffer[pos & mask].value()->~T(); }
+        delete[] buffer;
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+
+    template < class... Args >
+    requires std::is_nothrow_constructible_v< T, Args... >
+    bool try_emplace(Args&&... args) {
+        cell*       c;
+        std::size_t pos = enqueue_pos.load(std::memory_order::relaxed);
+        for (;;) {
+            c                        = &buffer[pos & mask];
+            std::size_t const    seq = c->sequence.load(std::memory_order::acquire);
+            std::intptr_t const diff = static_cast< std::intptr_t >(seq) - static_cast< std::intptr_t >(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order::relaxed)) { break; }
+                lockfree_stats::add(lockfree_stats::queue_push_cas_failure);
+            } else if (diff < 0) {
+                return false; // the cell still holds the value pushed one lap earlier: queue is full
+            } else {
+                pos = enqueue_pos.load(std::memory_order::relaxed); // another producer claimed this cell
+            }
+        }
+        ::new (static_cast< void* >(c->storage)) T(std::forward< Args >(args)...);
+        c->sequence.store(pos + 1, std::memory_order::release);
+        return true;
+    }
+
+    bool try_push(T&& new_value) { return try_emplace(std::move(new_value)); }
+    bool try_push(T const& new_value) {
+        if constexpr (std::is_nothrow_copy_constructible_v< T >) {
+            return try_emplace(new_value);
+        } else {
+            T copy(new_value); // copy before claiming a cell, so a throwing copy cannot leave a hole in the ring
+            return try_emplace(std::move(copy));
+        }
+    }
+
+    // Blocking push for thread pool injection: yields while the queue is full
+    void push(T&& new_value) {
+        while (!try_push(std::move(new_value))) { std::this_thread::yield(); }
+    }
+    void push(T const& new_value) {
+        T copy(new_value);
+        push(std::move(copy));
+    }
+
+    bool try_pop(T& value) {
+        cell*       c;
+        std::size_t pos = dequeue_pos.load(std::memory_order::relaxed);
+        for (;;) {
+            c                        = &buffer[pos & mask];
+            std::size_t const    seq = c->sequence.load(std::memory_order::acquire);
+            std::intptr_t const diff = static_cast< std::intptr_t >(seq) - static_cast< std::intptr_t >(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order::relaxed)) { break; }
+                lockfree_stats::add(lockfree_stats::queue_pop_cas_failure);
+            } else if (diff < 0) {
+                return false; // the cell has not been published yet: queue is empty
+            } else {
+                pos = dequeue_pos.load(std::memory_order::relaxed); // another consumer took this cell
+            }
+        }
+        T* const stored = c->value();
+        value           = std::move(*stored);
+        stored->~T();
+        c->sequence.store(pos + mask + 1, std::memory_order::release); // free the cell for the producer one lap ahead
+        return true;
+    }
+};
+
+// Bounded single-producer, single-consumer ring buffer
+// head and tail live on separate cache lines next to the owner's cached copy of the other index, so the opposite
+// index is only reloaded when the ring looks full (producer) or empty (consumer)
+template < class T >
+class alignas(cache_line_size) lock_free_queue_ring_SPSC {
+  private:
+    static std::size_t round_up_to_power_of_2(std::size_t capacity) {
+        std::size_t result = 2;
+        while (result < capacity) { result <<= 1; }
+        return result;
+    }
+
+    std::size_t const mask;
+    T* const          buffer;
+
+    alignas(cache_line_size) std::atomic< std::size_t > tail; // written by the producer only
+    std::size_t cached_head;                                  // producer's last seen head
+    alignas(cache_line_size) std::atomic< std::size_t > head; // written by the consumer only
+    std::size_t cached_tail;                                  // consumer's last seen tail
+
+    // Free cells seen by the producer, reloading head only when fewer than wanted are known to be free
+    std::size_t free_cells(std::size_t t, std::size_t wanted) {
+        std::size_t free = capacity() - (t - cached_head);
+        if (free < wanted) {
+            cached_head = head.load(std::memory_order::acquire);
+            free        = capacity() - (t - cached_head);
+        }
+        return free;
+    }
+    // Filled cells seen by the consumer, reloading tail only when fewer than wanted are known to be filled
+    std::size_t filled_cells(std::size_t h, std::size_t wanted) {
+        std::size_t filled = cached_tail - h;
+        if (filled < wanted) {
+            cached_tail = tail.load(std::memory_order::acquire);
+            filled      = cached_tail - h;
+        }
+        return filled;
+    }
+
+  public:
+    inline static std::size_t const default_capacity = 4096;
+
+    explicit lock_free_queue_ring_SPSC(std::size_t capacity = default_capacity) :
+        mask(round_up_to_power_of_2(capacity) - 1),
+        buffer(static_cast< T* >(::operator new(sizeof(T) * (mask + 1), std::align_val_t(alignof(T))))),
+        tail(0),
+        cached_head(0),
+        head(0),
+        cached_tail(0) {}
+
+    lock_free_queue_ring_SPSC(const lock_free_queue_ring_SPSC&) = delete;
+    lock_free_queue_ring_SPSC operator=(const lock_free_queue_ring_SPSC&) = delete;
+
+    ~lock_free_queue_ring_SPSC() {
+        for (std::size_t pos = head.load(); pos != tail.load(); ++pos) { buffer[pos & mask].~T(); }
+        ::operator delete(buffer, std::align_val_t(alignof(T)));
+    }
+
+    std::size_t capacity() const { return mask + 1; }
+
+    // Producer side
+    template < class... Args >
+    bool try_emplace(Args&&... args) {
+        std::size_t const t = tail.load(std::memory_order::relaxed);
+        if (!free_cells(t, 1)) { return false; }
+        ::new (static_cast< void* >(buffer + (t & mask))) T(std::forward< Args >(args)...);
+        tail.store(t + 1, std::memory_order::release);
+        return true;
+    }
+    bool try_push(T&& new_value) { return try_emplace(std::move(new_value)); }
+    bool try_push(T const& new_value) { return try_emplace(new_value); }
+
+    // Copies up to count values from first with a single release of tail, returns how many were pushed
+    template < class InputIt >
+    std::size_t push_n(InputIt first, std::size_t count) {
+        std::size_t const t = tail.load(std::memory_order::relaxed);
+        std::size_t const n = std::min(count, free_cells(t, count));
+        std::size_t       i = 0;
+        try {
+            for (; i < n; ++i, ++first) { ::new (static_cast< void* >(buffer + ((t + i) & mask))) T(*first); }
+        } catch (...) {
+            tail.store(t + i, std::memory_order::release); // publish the values constructed before the throw
+            throw;
+        }
+        tail.store(t + n, std::memory_order::release);
+        return n;
+    }
+
+    // Consumer side
+    bool try_pop(T& value) {
+        std::size_t const h = head.load(std::memory_order::relaxed);
+        if (!filled_cells(h, 1)) { return false; }
+        T* const stored = buffer + (h & mask);
+        value           = std::move(*stored);
+        stored->~T();
+        head.store(h + 1, std::memory_order::release);
+        return true;
+    }
+
+    // Moves up to count values into out with a single release of head, returns how many were popped
+    template < class OutputIt >
+    std::size_t pop_n(OutputIt out, std::size_t count) {
+        std::size_t const h = head.load(std::memory_order::relaxed);
+        std::size_t const n = std::min(count, filled_cells(h, count));
+        std::size_t       i = 0;
+        try {
+            for (; i < n; ++i, ++out) {
+                T* const stored = buffer + ((h + i) & mask);
+                *out            = std::move(*stored);
+                stored->~T();
+            }
+        } catch (...) {
+            head.store(h + i, std::memory_order::release); // the value that failed to move stays queued
+            throw;
+        }
+        head.store(h + n, std::memory_order::release);
+        return n;
+    }
+};
@@ -0,0 +1,249 @@
+#pragma once
+
+#include "cache_line.h"
+#include "epoch_domain.h"
+#include "node_allocator.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+
+// Concurrent hash map with separate chaining, where the chain of a bucket is copy-on-write. Published nodes are never
+// modified: a write copies the nodes in front of the one it changes and installs the new chain with one compare_exchange
+// on the bucket. A lookup is then a plain walk of the chain it loaded, without retries, which makes it wait-free.
+// Nodes and tables go through epoch_domain: a hazard pointer has to be validated in a loop before use, which no lookup
+// could bound.
+// The table doubles incrementally: writers move a chunk of buckets each to the next table, a bucket being frozen (no
+// write can succeed on it) while its chain is copied, then marked moved so that lookups continue in the next table.
+// The old table is retired once every bucket has moved.
+template < class Key, class Value, class Hash = std::hash< Key >, class KeyEqual = std::equal_to< Key >, class Allocator = default_node_allocator >
+class lock_free_hash_map {
+    static_assert(std::is_copy_constructible_v< Key > && std::is_copy_constructible_v< Value >, "chains are copied on write");
+
+  public:
+    inline static std::size_t const max_load_factor = 1;
+    inline static std::size_t const migration_chunk = 16; // buckets moved by a write while the table grows
+    inline static unsigned const    counter_stripes = 16;
+
+  private:
+    struct node {
+        std::size_t const hash;
+        node*             next; // set before the node is published, never after
+        Key const         key;
+        Value const       value;
+
+        node(std::size_t hash_, node* next_, Key const& key_, Value const& value_) : hash(hash_), next(next_), key(key_), value(value_) {}
+    };
+    static_assert(alignof(node) >= 4, "bucket words use the two low bits of node pointers");
+
+    // A bucket word is a node pointer, or'ed with frozen_bit while the table grows. pending and moved carry no pointer.
+    inline static std::uintptr_t const frozen_bit = 1;
+    inline static std::uintptr_t const pending    = 2; // bucket of a new table, not yet filled from the old one
+    inline static std::uintptr_t const moved      = 3; // bucket of an old table, its chain is in the next table
+
+    static node*          to_node(std::uintptr_t word) { return reinterpret_cast< node* >(word & ~frozen_bit); }
+    static std::uintptr_t to_word(node* n) { return reinterpret_cast< std::uintptr_t >(n); }
+
+    struct table {
+        std::size_t const                                  mask;
+        std::unique_ptr< std::atomic< std::uintptr_t >[] > buckets;
+        std::atomic< table* >                              next;
+        alignas(cache_line_size) std::atomic< std::size_t > next_chunk; // first bucket not yet claimed for migration
+        std::atomic< std::size_t >                          migrated;
+
+        table(std::size_t bucket_count, std::uintptr_t initial)
+            : mask(bucket_count - 1), buckets(new std::atomic< std::uintptr_t >[bucket_count]), next(nullptr), next_chunk(0), migrated(0) {
+            for (std::size_t i = 0; i < bucket_count; ++i) { buckets[i].store(initial, std::memory_order::relaxed); }
+        }
+
+        std::size_t                     size() const { return mask + 1; }
+        std::atomic< std::uintptr_t >& bucket(std::size_t hash) { return buckets[hash & mask]; }
+    };
+
+    struct alignas(cache_line_size) counter {
+        std::atomic< std::ptrdiff_t > value { 0 };
+    };
+
+    alignas(cache_line_size) std::atomic< table* > current;
+    counter                             counters[counter_stripes]; // element count, split to keep writers apart
+    [[no_unique_address]] Hash          hasher;
+    [[no_unique_address]] KeyEqual      key_equal;
+
+    counter& local_counter() {
+        thread_local unsigned const stripe = static_cast< unsigned >(std::hash< std::thread::id > {}(std::this_thread::get_id()) % counter_stripes);
+        return counters[stripe];
+    }
+
+    static void destroy_chain(node* n) {
+        while (n) {
+            node* const next = n->next;
+            Allocator::destroy(n);
+            n = next;
+        }
+    }
+
+    // Copies the chain of bucket index of from into the two buckets it splits into, then marks it moved.
+    // Several threads may copy the same bucket, only the first copy of each half is installed.
+    void migrate_bucket(table& from, table& to, std::size_t index) {
+        std::atomic< std::uintptr_t >& b    = from.buckets[index];
+        std::uintptr_t                 word = b.load();
+        while (!(word & frozen_bit) && !b.compare_exchange_weak(word, word | frozen_bit))
+            ;
+        if (word == moved) { return; }
+        word |= frozen_bit;
+
+        node* halves[2] = { nullptr, nullptr };
+        for (node* n = to_node(word); n; n = n->next) {
+            node*& half = halves[(n->hash & from.size()) != 0];
+            half        = Allocator::template create< node >(n->hash, half, n->key, n->value);
+        }
+        for (std::size_t i = 0; i < 2; ++i) {
+            std::uintptr_t expected = pending;
+            if (!to.buckets[index + i * from.size()].compare_exchange_strong(expected, to_word(halves[i]))) { destroy_chain(halves[i]); }
+        }
+        if (!b.compare_exchange_strong(word, moved)) { return; }
+        for (node* n = to_node(word); n;) {
+            node* const next = n->next;
+            epoch_domain::retire< Allocator >(n);
+            n = next;
+        }
+        if (from.migrated.fetch_add(1) + 1 == from.size()) {
+            table* expected = &from;
+            current.compare_exchange_strong(expected, &to);
+            epoch_domain::retire< new_delete_node_allocator >(&from);
+        }
+    }
+
+    void help_grow(table& from, table& to) {
+        std::size_t const first = from.next_chunk.fetch_add(migration_chunk);
+        std::size_t const last  = std::min(first + migration_chunk, from.size());
+        for (std::size_t i = first; i < last; ++i) { migrate_bucket(from, to, i); }
+    }
+
+    void grow(table& t) {
+        if (t.next.load() || current.load() != &t) { return; } // one table at a time
+        table*       expected = nullptr;
+        table* const bigger   = new table(2 * t.size(), pending);
+        if (!t.next.compare_exchange_strong(expected, bigger)) { delete bigger; }
+    }
+
+    // Replaces the chain of the bucket of key: the node holding key is left out if remove_existing, new_node (when not
+    // null) is put in front. Returns whether the chain held key, in which case nothing changes unless remove_existing.
+    bool write(std::size_t hash, Key const& key, node* new_node, bool remove_existing) {
+        epoch_domain::guard critical_section;
+        for (;;) {
+            table* t = current.load();
+            if (table* const next = t->next.load()) { help_grow(*t, *next); }
+            std::uintptr_t word = t->bucket(hash).load();
+            while (word & frozen_bit) { // the bucket is being moved or has moved, the write goes to the next table
+                table* const next = t->next.load();
+                migrate_bucket(*t, *next, hash & t->mask);
+                t    = next;
+                word = t->bucket(hash).load();
+            }
+
+            node* const head   = to_node(word);
+            node*       found  = nullptr;
+            std::size_t length = 0;
+            for (node* n = head; n; n = n->next, ++length) {
+                if (n->hash == hash && key_equal(n->key, key)) {
+                    found = n;
+                    break;
+                }
+            }
+            if (found ? !remove_existing : !new_node) { return found != nullptr; }
+
+            node*  first = found ? found->next : head; // copies of the nodes in front of found, linked to the rest
+            node** link  = &first;
+            for (node* n = head; found && n != found; n = n->next) {
+                *link = Allocator::template create< node >(n->hash, found->next, n->key, n->value);
+                link  = &(*link)->next;
+            }
+            if (new_node) {
+                new_node->next = first;
+                first          = new_node;
+            }
+
+            if (!t->bucket(hash).compare_exchange_strong(word, to_word(first))) {
+                for (node* n = new_node ? first->next : first; n != (found ? found->next : head);) {
+                    node* const next = n->next;
+                    Allocator::destroy(n);
+                    n = next;
+                }
+                continue;
+            }
+            for (node* n = head; found && n != found->next;) {
+                node* const next = n->next;
+                epoch_domain::retire< Allocator >(n);
+                n = next;
+            }
+            if (!found || !new_node) { local_counter().value.fetch_add(found ? -1 : 1, std::memory_order::relaxed); }
+            if (new_node && !found && length > max_load_factor && size() > max_load_factor * t->size()) { grow(*t); }
+            return found != nullptr;
+        }
+    }
+
+  public:
+    explicit lock_free_hash_map(std::size_t bucket_count = 64) : current(new table(std::bit_ceil(std::max< std::size_t >(bucket_count, 2)), 0)) {}
+
+    lock_free_hash_map(const lock_free_hash_map&) = delete;
+    lock_free_hash_map operator=(const lock_free_hash_map&) = delete;
+
+    ~lock_free_hash_map() {
+        table* const t = current.load();
+        for (table* const u : { t, t->next.load() }) { // a growth may be unfinished
+            if (!u) { continue; }
+            for (std::size_t i = 0; i < u->size(); ++i) {
+                std::uintptr_t const word = u->buckets[i].load();
+                if (word != pending && word != moved) { destroy_chain(to_node(word)); }
+            }
+            delete u;
+        }
+    }
+
+    // true if key was inserted, false if it was already there
+    bool insert(Key const& key, Value const& value) {
+        std::size_t const hash     = hasher(key);
+        node* const       new_node = Allocator::template create< node >(hash, nullptr, key, value);
+        if (!write(hash, key, new_node, false)) { return true; }
+        Allocator::destroy(new_node);
+        return false;
+    }
+    // true if key was inserted, false if its value was replaced
+    bool insert_or_assign(Key const& key, Value const& value) {
+        std::size_t const hash = hasher(key);
+        return !write(hash, key, Allocator::template create< node >(hash, nullptr, key, value), true);
+    }
+    bool erase(Key const& key) { return write(hasher(key), key, nullptr, true); }
+
+    // Wait-free
+    std::optional< Value > find(Key const& key) const {
+        std::size_t const   hash = hasher(key);
+        epoch_domain::guard critical_section;
+        table*              t    = current.load();
+        std::uintptr_t      word = t->bucket(hash).load();
+        while (word == moved) { // at most one hop per growth that completed during the lookup
+            t    = t->next.load();
+            word = t->bucket(hash).load();
+        }
+        for (node* n = to_node(word); n; n = n->next) {
+            if (n->hash == hash && key_equal(n->key, key)) { return n->value; }
+        }
+        return std::nullopt;
+    }
+    bool contains(Key const& key) const { return find(key).has_value(); }
+
+    // Exact when no write is in progress
+    std::size_t size() const {
+        std::ptrdiff_t total = 0;
+        for (counter const& c : counters) { total += c.value.load(std::memory_order::relaxed); }
+        return static_cast< std::size_t >(std::max< std::ptrdiff_t >(total, 0));
+    }
+};
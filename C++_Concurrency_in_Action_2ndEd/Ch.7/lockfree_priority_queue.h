@@ -0,0 +1,94 @@
+#pragma once
+
+#include "lockfree_skiplist.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <utility>
+
+// Relaxed priority queue over lock_free_skiplist, values ordered by Priority (smallest first with std::less).
+// Equal priorities are told apart by the pushing thread and its push count, so every push succeeds.
+// delete_min() does not always race for the first node: it jumps a random number of nodes along a few of the lowest
+// levels and takes the node where it lands, among the first O(p log p) ones with p threads. With one thread this is
+// the first node. When the landing node is gone it moves on along level 0, when nothing is left there it starts over
+// from the front, so delete_min() returns nullopt only for an empty queue.
+// see more about the technique: Dan Alistarh, Justin Kopinsky, Jerry Li and Nir Shavit, The SprayList: a scalable
+// relaxed priority queue, 2015
+template < class Priority, class T, class Compare = std::less< Priority >, class Allocator = default_node_allocator >
+class lock_free_priority_queue {
+    struct entry_key {
+        Priority      priority;
+        std::uint64_t thread;
+        std::uint64_t sequence;
+    };
+    struct entry_less {
+        [[no_unique_address]] Compare less;
+
+        bool operator()(entry_key const& a, entry_key const& b) const {
+            if (less(a.priority, b.priority)) { return true; }
+            if (less(b.priority, a.priority)) { return false; }
+            return std::tie(a.thread, a.sequence) < std::tie(b.thread, b.sequence);
+        }
+    };
+
+    class skiplist : public lock_free_skiplist< entry_key, T, entry_less, Allocator > {
+        using base = lock_free_skiplist< entry_key, T, entry_less, Allocator >;
+        using typename base::link;
+        using typename base::node;
+
+      public:
+        // A node among the first ones at level 0, nullptr if the walk did not move
+        node* spray(unsigned height, unsigned max_jump) {
+            link* pred   = this->head;
+            node* landed = nullptr;
+            for (unsigned level = height; level-- > 0;) {
+                for (unsigned jump = base::random_bits() % (max_jump + 1); jump; --jump) {
+                    node* const next = base::to_node(pred[level].load());
+                    if (!next) { break; }
+                    pred   = next->next;
+                    landed = next;
+                }
+            }
+            return landed;
+        }
+
+        std::optional< std::pair< Priority, T > > delete_min(unsigned height, unsigned max_jump) {
+            epoch_domain::guard critical_section;
+            for (node* n = spray(height, max_jump);; n = base::to_node(n->next[0].load())) {
+                if (!n) { // past the last node, or the spray did not move
+                    n = base::to_node(this->head[0].load());
+                    while (n && base::is_marked(n->next[0].load())) { n = base::to_node(n->next[0].load()); }
+                    if (!n) { return std::nullopt; }
+                }
+                if (this->remove(n)) { return std::pair< Priority, T >(n->key.priority, std::move(n->value)); }
+            }
+        }
+    };
+
+    inline static std::atomic< std::uint64_t > thread_count { 0 };
+
+    skiplist       list;
+    unsigned const spray_height; // log2(p) + 1 levels
+    unsigned const spray_jump;   // at most log2(p) + 1 nodes per level
+
+  public:
+    lock_free_priority_queue()
+        : spray_height(std::min< unsigned >(std::bit_width(std::max(std::thread::hardware_concurrency(), 1u)), 16)), spray_jump(spray_height) {}
+
+    lock_free_priority_queue(const lock_free_priority_queue&) = delete;
+    lock_free_priority_queue operator=(const lock_free_priority_queue&) = delete;
+
+    void push(Priority const& priority, T value) {
+        thread_local std::uint64_t const thread   = thread_count.fetch_add(1, std::memory_order::relaxed);
+        thread_local std::uint64_t       sequence = 0;
+        list.emplace(entry_key { priority, thread, sequence++ }, std::move(value));
+    }
+
+    // One of the values with the smallest priorities, nullopt if the queue is empty
+    std::optional< std::pair< Priority, T > > delete_min() { return list.delete_min(spray_height, spray_jump); }
+};
@@ -1,12 +1,25 @@
 #pragma once
 
+#include "backoff.h"
+#include "counted_node_ptr.h"
+#include "lockfree_stats.h"
+#include "node_allocator.h"
+#include "reclaimer.h"
 #include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstring>
 #include <functional>
 #include <memory>
+#include <new>
+#include <optional>
 #include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 // Listing 7.13 A single-producer, single-consumer lock-free queue
-template < class T >
+template < class T, class Allocator = default_node_allocator >
 class lock_free_queue_7_13_SPSC {
   private:
     struct node {
@@ -19,15 +32,17 @@ class lock_free_queue_7_13_SPSC {
     std::atomic< node* > head;
     std::atomic< node* > tail;
 
+    // Only pop() writes head and only push() writes tail, so each side reads its own end relaxed. The release store of
+    // tail publishes the value and the next node to the acquire load in pop_head(); head is not read by push() at all.
     node* pop_head() {
-        node* const old_head = head.load();
-        if (old_head == tail.load()) { return nullptr; }
-        head.store(old_head->next);
+        node* const old_head = head.load(std::memory_order::relaxed);
+        if (old_head == tail.load(std::memory_order::acquire)) { return nullptr; }
+        head.store(old_head->next, std::memory_order::relaxed);
         return old_head;
     }
 
   public:
-    lock_free_queue_7_13_SPSC() : head(new node), tail(head.load()) {}
+    lock_free_queue_7_13_SPSC() : head(Allocator::template create< node >()), tail(head.load()) {}
 
     lock_free_queue_7_13_SPSC(const lock_free_queue_7_13_SPSC&) = delete;
     lock_free_queue_7_13_SPSC operator=(const lock_free_queue_7_13_SPSC&) = delete;
@@ -35,7 +50,7 @@ class lock_free_queue_7_13_SPSC {
     ~lock_free_queue_7_13_SPSC() {
         while (node* const old_head = head.load()) {
             head.store(old_head->next);
-            delete old_head;
+            Allocator::destroy(old_head);
         }
     }
     std::shared_ptr< T > pop() {
@@ -43,30 +58,28 @@ class lock_free_queue_7_13_SPSC {
         if (!old_head) { return nullptr; }
 
         std::shared_ptr< T > const res(old_head->data);
-        delete old_head;
+        Allocator::destroy(old_head);
         return res;
     }
     void push(T new_value) {
         std::shared_ptr< T > new_data(std::make_shared< T >(new_value));
-        node*                p        = new node;
-        node* const          old_tail = tail.load();
+        node*                p        = Allocator::template create< node >();
+        node* const          old_tail = tail.load(std::memory_order::relaxed);
         old_tail->data.swap(new_data);
         old_tail->next = p;
-        tail.store(p);
+        tail.store(p, std::memory_order::release);
     }
 };
 
 // Listing 7.15 Implementing push() for a lock-free queue with a reference-counted tail
 // see more about the technique: Atomic Ptr Plus Project, http://atomic-ptr-plus.sourceforge.net/.
-template < class T >
+// Every CAS retry loop of the reference-counted queues pauses according to Backoff, see backoff.h
+template < class T, class Allocator = default_node_allocator, class Backoff = no_backoff, class CountedPtr = default_counted_ptr >
 class lock_free_queue_RC_tail {
   private:
     struct node;
 
-    struct counted_node_ptr {
-        int   external_count;
-        node* ptr;
-    };
+    using counted_node_ptr = typename CountedPtr::template type< node >;
 
     std::atomic< counted_node_ptr > head;
     std::atomic< counted_node_ptr > tail;
@@ -85,45 +98,61 @@ class lock_free_queue_RC_tail {
             new_count.internal_count    = 0;
             new_count.external_counters = 2;
             count.store(new_count);
-            next.ptr            = nullptr;
-            next.external_count = 0;
         }
 
         void release_ref() {
             node_counter old_counter = count.load(std::memory_order::relaxed);
             node_counter new_counter;
-            do {
+            for (Backoff backoff;; backoff.pause()) {
                 new_counter = old_counter;
                 --new_counter.internal_count;
-            } while (!count.compare_exchange_strong(old_counter, new_counter, std::memory_order::acquire, std::memory_order::relaxed));
-            if (!new_counter.internal_count && !new_counter.external_counters) { delete this; }
+                if (count.compare_exchange_strong(old_counter, new_counter, std::memory_order::acq_rel, std::memory_order::relaxed)) { break; }
+            }
+            if (!new_counter.internal_count && !new_counter.external_counters) { Allocator::destroy(this); }
         }
     };
 
     static void increase_external_count(std::atomic< counted_node_ptr >& counter, counted_node_ptr& old_counter) {
         counted_node_ptr new_counter;
-        do {
+        for (Backoff backoff;; backoff.pause()) {
             new_counter = old_counter;
-            ++new_counter.external_count;
-        } while (!counter.compare_exchange_strong(old_counter, new_counter, std::memory_order::acquire, std::memory_order::relaxed));
-        old_counter.external_count = new_counter.external_count;
+            new_counter.set_external_count(old_counter.external_count() + 1);
+            if (counter.compare_exchange_strong(old_counter, new_counter, std::memory_order::acquire, std::memory_order::relaxed)) { break; }
+        }
+        old_counter = new_counter;
+    }
+
+    // Drops a reference to ptr taken by increase_external_count(), old_counter is the last value read from counter.
+    // While counter still points at ptr the reference is given back in place, so retrying on an unchanged head or
+    // tail does not make the external count grow, otherwise it is released through the internal count as in the listings
+    static void decrease_external_count(std::atomic< counted_node_ptr >& counter, counted_node_ptr& old_counter, node* ptr) {
+        for (Backoff backoff; old_counter.ptr() == ptr; backoff.pause()) {
+            counted_node_ptr new_counter = old_counter;
+            new_counter.set_external_count(old_counter.external_count() - 1);
+            if (counter.compare_exchange_weak(old_counter, new_counter, std::memory_order::release, std::memory_order::relaxed)) {
+                old_counter = new_counter;
+                return;
+            }
+        }
+        ptr->release_ref();
     }
 
     static void free_external_counter(counted_node_ptr& old_node_ptr) {
-        node* const  ptr            = old_node_ptr.ptr;
-        int const    count_increase = old_node_ptr.external_count - 2;
+        node* const  ptr            = old_node_ptr.ptr();
+        int const    count_increase = old_node_ptr.external_count() - 2;
         node_counter old_counter    = ptr->count.load(std::memory_order::relaxed);
         node_counter new_counter;
-        do {
+        for (Backoff backoff;; backoff.pause()) {
             new_counter = old_counter;
             --new_counter.external_counters;
             new_counter.internal_count += count_increase;
-        } while (!ptr->count.compare_exchange_strong(old_counter, new_counter, std::memory_order::acquire, std::memory_order::relaxed));
-        if (!new_counter.internal_count && !new_counter.external_counters) { delete ptr; }
+            if (ptr->count.compare_exchange_strong(old_counter, new_counter, std::memory_order::acq_rel, std::memory_order::relaxed)) { break; }
+        }
+        if (!new_counter.internal_count && !new_counter.external_counters) { Allocator::destroy(ptr); }
     }
 
   public:
-    lock_free_queue_RC_tail() : head(counted_node_ptr{0, new node}), tail(head.load()) {}
+    lock_free_queue_RC_tail() : head(counted_node_ptr(1, Allocator::template create< node >())), tail(head.load()) {}
 
     lock_free_queue_RC_tail(const lock_free_queue_RC_tail&) = delete;
     lock_free_queue_RC_tail operator=(const lock_free_queue_RC_tail&) = delete;
@@ -131,63 +160,62 @@ class lock_free_queue_RC_tail {
     ~lock_free_queue_RC_tail() {
         counted_node_ptr old_head = head.load();
 
-        while (old_head.ptr) {
-            head.store(old_head.ptr->next);
-            delete old_head.ptr;
+        while (old_head.ptr()) {
+            head.store(old_head.ptr()->next);
+            delete old_head.ptr()->data.load();
+            Allocator::destroy(old_head.ptr());
             old_head = head.load();
         }
     }
 
     void push(T new_value) {
         std::unique_ptr< T > new_data(new T(new_value));
-        counted_node_ptr     new_next {};
-        new_next.ptr              = new node;
-        new_next.external_count   = 1;
-        counted_node_ptr old_tail = tail.load();
-        for (;;) {
+        counted_node_ptr     new_next(1, Allocator::template create< node >());
+        counted_node_ptr     old_tail = tail.load();
+        for (Backoff backoff;; backoff.pause()) {
             increase_external_count(tail, old_tail);
             T* old_data = nullptr;
-            if (old_tail.ptr->data.compare_exchange_strong(old_data, new_data.get())) {
-                old_tail.ptr->next = new_next;
+            if (old_tail.ptr()->data.compare_exchange_strong(old_data, new_data.get())) {
+                old_tail.ptr()->next = new_next;
                 old_tail           = tail.exchange(new_next);
                 free_external_counter(old_tail);
                 new_data.release();
                 break;
             }
-            old_tail.ptr->release_ref();
+            lockfree_stats::add(lockfree_stats::queue_push_cas_failure);
+            decrease_external_count(tail, old_tail, old_tail.ptr());
         }
     }
 
     std::unique_ptr< T > pop() {
         counted_node_ptr old_head = head.load(std::memory_order_relaxed);
-        for (;;) {
+        for (Backoff backoff;; backoff.pause()) {
             increase_external_count(head, old_head);
-            node* const ptr = old_head.ptr;
-            if (ptr == tail.load().ptr) {
-                ptr->release_ref();
+            node* const ptr = old_head.ptr();
+            if (ptr == tail.load().ptr()) {
+                decrease_external_count(head, old_head, ptr);
                 return std::unique_ptr< T >();
             }
             if (head.compare_exchange_strong(old_head, ptr->next)) {
-                T* const res = ptr->data.exchange(nullptr);
+                // data is left set: a pusher still holding a counted reference to this node must not be able to claim it again
+                T* const res = ptr->data.load();
                 free_external_counter(old_head);
                 return std::unique_ptr< T >(res);
             }
-            ptr->release_ref();
+            lockfree_stats::add(lockfree_stats::queue_pop_cas_failure);
+            decrease_external_count(head, old_head, ptr);
         }
     }
 };
 
 // Listing 7.20 pop() modified to allow helping on the push() side
 // Listing 7.21 A sample push() with helping for a lock-free queue
-template < class T >
+template < class T, class Allocator = default_node_allocator, class Backoff = no_backoff, class CountedPtr = default_counted_ptr >
 class lock_free_queue_RC_tail_modified {
   private:
     struct node;
 
-    struct counted_node_ptr {
-        int   external_count;
-        node* ptr;
-    };
+    using counted_node_ptr = typename CountedPtr::template type< node >;
 
     std::atomic< counted_node_ptr > head;
     std::atomic< counted_node_ptr > tail;
@@ -205,55 +233,77 @@ class lock_free_queue_RC_tail_modified {
             node_counter new_count {};
             new_count.internal_count    = 0;
             new_count.external_counters = 2;
-            count.store(new_count);
-            next.store(counted_node_ptr{0, nullptr});
+            count.store(new_count, std::memory_order::relaxed); // published by the release operation that links the node
+            next.store(counted_node_ptr(), std::memory_order::relaxed);
         }
 
         void release_ref() {
             node_counter old_counter = count.load(std::memory_order::relaxed);
             node_counter new_counter;
-            do {
+            // acq_rel: the thread that frees the node must see the accesses of all threads that dropped a reference before
+            for (Backoff backoff;; backoff.pause()) {
                 new_counter = old_counter;
                 --new_counter.internal_count;
-            } while (!count.compare_exchange_strong(old_counter, new_counter, std::memory_order::acquire, std::memory_order::relaxed));
-            if (!new_counter.internal_count && !new_counter.external_counters) { delete this; }
+                if (count.compare_exchange_strong(old_counter, new_counter, std::memory_order::acq_rel, std::memory_order::relaxed)) { break; }
+            }
+            if (!new_counter.internal_count && !new_counter.external_counters) { Allocator::destroy(this); }
         }
     };
 
     static void increase_external_count(std::atomic< counted_node_ptr >& counter, counted_node_ptr& old_counter) {
         counted_node_ptr new_counter;
-        do {
+        for (Backoff backoff;; backoff.pause()) {
             new_counter = old_counter;
-            ++new_counter.external_count;
-        } while (!counter.compare_exchange_strong(old_counter, new_counter, std::memory_order::acquire, std::memory_order::relaxed));
-        old_counter.external_count = new_counter.external_count;
+            new_counter.set_external_count(old_counter.external_count() + 1);
+            if (counter.compare_exchange_strong(old_counter, new_counter, std::memory_order::acquire, std::memory_order::relaxed)) { break; }
+        }
+        old_counter = new_counter;
+    }
+
+    // Drops a reference to ptr taken by increase_external_count(), old_counter is the last value read from counter.
+    // While counter still points at ptr the reference is given back in place, so retrying on an unchanged head or
+    // tail does not make the external count grow, otherwise it is released through the internal count as in the listings
+    static void decrease_external_count(std::atomic< counted_node_ptr >& counter, counted_node_ptr& old_counter, node* ptr) {
+        for (Backoff backoff; old_counter.ptr() == ptr; backoff.pause()) {
+            counted_node_ptr new_counter = old_counter;
+            new_counter.set_external_count(old_counter.external_count() - 1);
+            if (counter.compare_exchange_weak(old_counter, new_counter, std::memory_order::release, std::memory_order::relaxed)) {
+                old_counter = new_counter;
+                return;
+            }
+        }
+        ptr->release_ref();
     }
 
     static void free_external_counter(counted_node_ptr& old_node_ptr) {
-        node* const  ptr            = old_node_ptr.ptr;
-        int const    count_increase = old_node_ptr.external_count - 2;
+        node* const  ptr            = old_node_ptr.ptr();
+        int const    count_increase = old_node_ptr.external_count() - 2;
         node_counter old_counter    = ptr->count.load(std::memory_order::relaxed);
         node_counter new_counter;
-        do {
+        for (Backoff backoff;; backoff.pause()) {
             new_counter = old_counter;
             --new_counter.external_counters;
             new_counter.internal_count += count_increase;
-        } while (!ptr->count.compare_exchange_strong(old_counter, new_counter, std::memory_order::acquire, std::memory_order::relaxed));
-        if (!new_counter.internal_count && !new_counter.external_counters) { delete ptr; }
+            if (ptr->count.compare_exchange_strong(old_counter, new_counter, std::memory_order::acq_rel, std::memory_order::relaxed)) { break; }
+        }
+        if (!new_counter.internal_count && !new_counter.external_counters) { Allocator::destroy(ptr); }
     }
 
     void set_new_tail(counted_node_ptr& old_tail, counted_node_ptr const& new_tail) {
-        node* const current_tail_ptr = old_tail.ptr;
-        while (!tail.compare_exchange_weak(old_tail, new_tail) && old_tail.ptr == current_tail_ptr)
-            ;
-        if (old_tail.ptr == current_tail_ptr)
+        node* const current_tail_ptr = old_tail.ptr();
+        Backoff backoff;
+        while (!tail.compare_exchange_weak(old_tail, new_tail, std::memory_order::release, std::memory_order::relaxed) &&
+               old_tail.ptr() == current_tail_ptr) {
+            backoff.pause();
+        }
+        if (old_tail.ptr() == current_tail_ptr)
             free_external_counter(old_tail);
         else
             current_tail_ptr->release_ref();
     }
 
   public:
-    lock_free_queue_RC_tail_modified() : head(counted_node_ptr{0, new node}), tail(head.load()) {}
+    lock_free_queue_RC_tail_modified() : head(counted_node_ptr(1, Allocator::template create< node >())), tail(head.load()) {}
 
     lock_free_queue_RC_tail_modified(const lock_free_queue_RC_tail_modified&) = delete;
     lock_free_queue_RC_tail_modified operator=(const lock_free_queue_RC_tail_modified&) = delete;
@@ -261,36 +311,36 @@ class lock_free_queue_RC_tail_modified {
     ~lock_free_queue_RC_tail_modified() {
         counted_node_ptr old_head = head.load();
 
-        while (old_head.ptr) {
-            head.store(old_head.ptr->next);
-            delete old_head.ptr;
+        while (old_head.ptr()) {
+            head.store(old_head.ptr()->next);
+            delete old_head.ptr()->data.load();
+            Allocator::destroy(old_head.ptr());
             old_head = head.load();
         }
     }
 
     void push(const T& new_value) {
         std::unique_ptr< T > new_data(new T(new_value));
-        counted_node_ptr     new_next {};
-        new_next.ptr              = new node;
-        new_next.external_count   = 1;
-        counted_node_ptr old_tail = tail.load();
-        for (;;) {
+        counted_node_ptr     new_next(1, Allocator::template create< node >());
+        counted_node_ptr     old_tail = tail.load(std::memory_order::relaxed);
+        for (Backoff backoff;; backoff.pause()) {
             increase_external_count(tail, old_tail);
             T* old_data = nullptr;
-            if (old_tail.ptr->data.compare_exchange_strong(old_data, new_data.get())) {
-                counted_node_ptr old_next = { 0 };
-                if (!old_tail.ptr->next.compare_exchange_strong(old_next, new_next)) {
-                    delete new_next.ptr;
+            if (old_tail.ptr()->data.compare_exchange_strong(old_data, new_data.get(), std::memory_order::release, std::memory_order::relaxed)) {
+                counted_node_ptr old_next;
+                if (!old_tail.ptr()->next.compare_exchange_strong(old_next, new_next, std::memory_order::release, std::memory_order::acquire)) {
+                    Allocator::destroy(new_next.ptr());
                     new_next = old_next;
                 }
                 set_new_tail(old_tail, new_next);
                 new_data.release();
                 break;
             } else {
-                counted_node_ptr old_next = { 0 };
-                if (old_tail.ptr->next.compare_exchange_strong(old_next, new_next)) {
+                lockfree_stats::add(lockfree_stats::queue_push_cas_failure);
+                counted_node_ptr old_next;
+                if (old_tail.ptr()->next.compare_exchange_strong(old_next, new_next, std::memory_order::release, std::memory_order::acquire)) {
                     old_next     = new_next;
-                    new_next.ptr = new node;
+                    new_next.set_ptr(Allocator::template create< node >());
                 }
                 set_new_tail(old_tail, old_next);
             }
@@ -299,27 +349,26 @@ class lock_free_queue_RC_tail_modified {
 
     void push(T&& new_value) {
         std::unique_ptr< T > new_data(new T(std::move(new_value)));
-        counted_node_ptr     new_next {};
-        new_next.ptr              = new node;
-        new_next.external_count   = 1;
-        counted_node_ptr old_tail = tail.load();
-        for (;;) {
+        counted_node_ptr     new_next(1, Allocator::template create< node >());
+        counted_node_ptr     old_tail = tail.load(std::memory_order::relaxed);
+        for (Backoff backoff;; backoff.pause()) {
             increase_external_count(tail, old_tail);
             T* old_data = nullptr;
-            if (old_tail.ptr->data.compare_exchange_strong(old_data, new_data.get())) {
-                counted_node_ptr old_next = { 0 };
-                if (!old_tail.ptr->next.compare_exchange_strong(old_next, new_next)) {
-                    delete new_next.ptr;
+            if (old_tail.ptr()->data.compare_exchange_strong(old_data, new_data.get(), std::memory_order::release, std::memory_order::relaxed)) {
+                counted_node_ptr old_next;
+                if (!old_tail.ptr()->next.compare_exchange_strong(old_next, new_next, std::memory_order::release, std::memory_order::acquire)) {
+                    Allocator::destroy(new_next.ptr());
                     new_next = old_next;
                 }
                 set_new_tail(old_tail, new_next);
                 new_data.release();
                 break;
             } else {
-                counted_node_ptr old_next = { 0 };
-                if (old_tail.ptr->next.compare_exchange_strong(old_next, new_next)) {
+                lockfree_stats::add(lockfree_stats::queue_push_cas_failure);
+                counted_node_ptr old_next;
+                if (old_tail.ptr()->next.compare_exchange_strong(old_next, new_next, std::memory_order::release, std::memory_order::acquire)) {
                     old_next     = new_next;
-                    new_next.ptr = new node;
+                    new_next.set_ptr(Allocator::template create< node >());
                 }
                 set_new_tail(old_tail, old_next);
             }
@@ -328,17 +377,397 @@ class lock_free_queue_RC_tail_modified {
 
     std::unique_ptr< T > pop() {
         counted_node_ptr old_head = head.load(std::memory_order_relaxed);
-        for (;;) {
+        for (Backoff backoff;; backoff.pause()) {
+            increase_external_count(head, old_head);
+            node* const ptr = old_head.ptr();
+            // tail moves past a node only once its data and next are set: the acquire load of tail is what lets the
+            // relaxed loads of next and head below reach initialized nodes
+            if (ptr == tail.load(std::memory_order::acquire).ptr()) {
+                decrease_external_count(head, old_head, ptr);
+                return nullptr;
+            }
+            counted_node_ptr next = ptr->next.load(std::memory_order::relaxed);
+            if (head.compare_exchange_strong(old_head, next, std::memory_order::relaxed)) {
+                // data is left set: a pusher still holding a counted reference to this node must not be able to claim it again
+                T* const res = ptr->data.load(std::memory_order::acquire);
+                free_external_counter(old_head);
+                return std::unique_ptr< T >(res);
+            }
+            lockfree_stats::add(lockfree_stats::queue_pop_cas_failure);
+            decrease_external_count(head, old_head, ptr);
+        }
+    }
+
+    bool try_pop(T& value) {
+        std::unique_ptr< T > const res = pop();
+        if (!res) { return false; }
+        value = std::move(*res);
+        return true;
+    }
+};
+
+// Value slot of an inline queue node, taking the place of the std::atomic< T* > data of the listings above.
+// A push claims the slot of the tail node and then constructs its value in place, so a pop that dequeued the node
+// may briefly wait for that construction to finish. Once taken the slot stays claimed, so a pusher still holding a
+// counted reference to the dequeued node cannot fill it again.
+template < class T, bool Packed = std::is_trivially_copyable_v< T > && (sizeof(T) < sizeof(std::uintptr_t)) >
+class queue_value_slot {
+    static_assert(std::is_nothrow_move_constructible_v< T >, "a claimed slot must always be filled");
+
+    enum state_type : unsigned char { empty, claimed, ready, taken };
+
+    std::atomic< state_type > state;
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T* value() { return std::launder(reinterpret_cast< T* >(storage)); }
+
+  public:
+    queue_value_slot() : state(empty) {}
+
+    queue_value_slot(const queue_value_slot&) = delete;
+    queue_value_slot operator=(const queue_value_slot&) = delete;
+
+    ~queue_value_slot() {
+        if (state.load(std::memory_order::relaxed) == ready) { value()->~T(); }
+    }
+
+    // Captures the constructor arguments once, try_publish() may then be attempted on several nodes
+    template < class... Args >
+    requires std::is_nothrow_constructible_v< T, Args... >
+    static std::tuple< Args&&... > prepare(Args&&... args) {
+        return std::forward_as_tuple(std::forward< Args >(args)...);
+    }
+
+    template < class Prepared >
+    bool try_publish(Prepared& args) {
+        state_type expected = empty;
+        if (!state.compare_exchange_strong(expected, claimed)) { return false; }
+        std::apply([this](auto&&... a) { ::new (static_cast< void* >(storage)) T(std::forward< decltype(a) >(a)...); }, std::move(args));
+        state.store(ready, std::memory_order::release);
+        return true;
+    }
+
+    T take() {
+        while (state.load(std::memory_order::acquire) != ready) { std::this_thread::yield(); }
+        T res(std::move(*value()));
+        value()->~T();
+        state.store(taken, std::memory_order::relaxed);
+        return res;
+    }
+};
+
+// Small trivially copyable values live in the pointer-sized atomic itself: claiming the slot and publishing the value
+// is a single CAS from 0, the top bit marks the slot as full even for an all-zero value
+template < class T >
+class queue_value_slot< T, true > {
+    inline static std::uintptr_t const full_flag = std::uintptr_t(1) << (sizeof(std::uintptr_t) * CHAR_BIT - 1);
+
+    std::atomic< std::uintptr_t > word;
+
+  public:
+    queue_value_slot() : word(0) {}
+
+    queue_value_slot(const queue_value_slot&) = delete;
+    queue_value_slot operator=(const queue_value_slot&) = delete;
+
+    template < class... Args >
+    static std::uintptr_t prepare(Args&&... args) {
+        T const        value(std::forward< Args >(args)...);
+        std::uintptr_t packed = 0;
+        std::memcpy(&packed, &value, sizeof(T));
+        return packed | full_flag;
+    }
+
+    bool try_publish(std::uintptr_t packed) {
+        std::uintptr_t expected = 0;
+        return word.compare_exchange_strong(expected, packed);
+    }
+
+    T take() {
+        std::uintptr_t const packed = word.load();
+        alignas(T) unsigned char buffer[sizeof(T)];
+        std::memcpy(buffer, &packed, sizeof(T));
+        return *std::launder(reinterpret_cast< T* >(buffer));
+    }
+};
+
+// Listing 7.21 with the value stored in the node instead of a separately allocated T:
+// one allocation per push, emplace() and move-only types are supported, pop() returns std::optional< T >
+template < class T, class Allocator = default_node_allocator, class Backoff = no_backoff, class CountedPtr = default_counted_ptr >
+class lock_free_queue_RC_tail_inline {
+  private:
+    struct node;
+
+    using counted_node_ptr = typename CountedPtr::template type< node >;
+
+    std::atomic< counted_node_ptr > head;
+    std::atomic< counted_node_ptr > tail;
+
+    struct node_counter {
+        unsigned internal_count : 30;
+        unsigned external_counters : 2;
+    };
+
+    using slot_type = queue_value_slot< T >;
+
+    struct node {
+        slot_type                       data;
+        std::atomic< node_counter >     count;
+        std::atomic< counted_node_ptr > next;
+        node() {
+            node_counter new_count {};
+            new_count.internal_count    = 0;
+            new_count.external_counters = 2;
+            count.store(new_count);
+            next.store(counted_node_ptr());
+        }
+
+        void release_ref() {
+            node_counter old_counter = count.load(std::memory_order::relaxed);
+            node_counter new_counter;
+            for (Backoff backoff;; backoff.pause()) {
+                new_counter = old_counter;
+                --new_counter.internal_count;
+                if (count.compare_exchange_strong(old_counter, new_counter, std::memory_order::acq_rel, std::memory_order::relaxed)) { break; }
+            }
+            if (!new_counter.internal_count && !new_counter.external_counters) { Allocator::destroy(this); }
+        }
+    };
+
+    static void increase_external_count(std::atomic< counted_node_ptr >& counter, counted_node_ptr& old_counter) {
+        counted_node_ptr new_counter;
+        for (Backoff backoff;; backoff.pause()) {
+            new_counter = old_counter;
+            new_counter.set_external_count(old_counter.external_count() + 1);
+            if (counter.compare_exchange_strong(old_counter, new_counter, std::memory_order::acquire, std::memory_order::relaxed)) { break; }
+        }
+        old_counter = new_counter;
+    }
+
+    // Drops a reference to ptr taken by increase_external_count(), old_counter is the last value read from counter.
+    // While counter still points at ptr the reference is given back in place, so retrying on an unchanged head or
+    // tail does not make the external count grow, otherwise it is released through the internal count as in the listings
+    static void decrease_external_count(std::atomic< counted_node_ptr >& counter, counted_node_ptr& old_counter, node* ptr) {
+        for (Backoff backoff; old_counter.ptr() == ptr; backoff.pause()) {
+            counted_node_ptr new_counter = old_counter;
+            new_counter.set_external_count(old_counter.external_count() - 1);
+            if (counter.compare_exchange_weak(old_counter, new_counter, std::memory_order::release, std::memory_order::relaxed)) {
+                old_counter = new_counter;
+                return;
+            }
+        }
+        ptr->release_ref();
+    }
+
+    static void free_external_counter(counted_node_ptr& old_node_ptr) {
+        node* const  ptr            = old_node_ptr.ptr();
+        int const    count_increase = old_node_ptr.external_count() - 2;
+        node_counter old_counter    = ptr->count.load(std::memory_order::relaxed);
+        node_counter new_counter;
+        for (Backoff backoff;; backoff.pause()) {
+            new_counter = old_counter;
+            --new_counter.external_counters;
+            new_counter.internal_count += count_increase;
+            if (ptr->count.compare_exchange_strong(old_counter, new_counter, std::memory_order::acq_rel, std::memory_order::relaxed)) { break; }
+        }
+        if (!new_counter.internal_count && !new_counter.external_counters) { Allocator::destroy(ptr); }
+    }
+
+    void set_new_tail(counted_node_ptr& old_tail, counted_node_ptr const& new_tail) {
+        node* const current_tail_ptr = old_tail.ptr();
+        Backoff backoff;
+        while (!tail.compare_exchange_weak(old_tail, new_tail) && old_tail.ptr() == current_tail_ptr) { backoff.pause(); }
+        if (old_tail.ptr() == current_tail_ptr)
+            free_external_counter(old_tail);
+        else
+            current_tail_ptr->release_ref();
+    }
+
+    template < class Prepared >
+    void push_prepared(Prepared prepared) {
+        counted_node_ptr new_next(1, Allocator::template create< node >());
+        counted_node_ptr old_tail = tail.load();
+        for (Backoff backoff;; backoff.pause()) {
+            increase_external_count(tail, old_tail);
+            if (old_tail.ptr()->data.try_publish(prepared)) {
+                counted_node_ptr old_next;
+                if (!old_tail.ptr()->next.compare_exchange_strong(old_next, new_next)) {
+                    Allocator::destroy(new_next.ptr());
+                    new_next = old_next;
+                }
+                set_new_tail(old_tail, new_next);
+                break;
+            } else {
+                lockfree_stats::add(lockfree_stats::queue_push_cas_failure);
+                counted_node_ptr old_next;
+                if (old_tail.ptr()->next.compare_exchange_strong(old_next, new_next)) {
+                    old_next     = new_next;
+                    new_next.set_ptr(Allocator::template create< node >());
+                }
+                set_new_tail(old_tail, old_next);
+            }
+        }
+    }
+
+  public:
+    lock_free_queue_RC_tail_inline() : head(counted_node_ptr(1, Allocator::template create< node >())), tail(head.load()) {}
+
+    lock_free_queue_RC_tail_inline(const lock_free_queue_RC_tail_inline&) = delete;
+    lock_free_queue_RC_tail_inline operator=(const lock_free_queue_RC_tail_inline&) = delete;
+
+    ~lock_free_queue_RC_tail_inline() {
+        counted_node_ptr old_head = head.load();
+
+        while (old_head.ptr()) {
+            head.store(old_head.ptr()->next);
+            Allocator::destroy(old_head.ptr());
+            old_head = head.load();
+        }
+    }
+
+    template < class... Args >
+    void emplace(Args&&... args) {
+        if constexpr (requires { slot_type::prepare(std::forward< Args >(args)...); }) {
+            push_prepared(slot_type::prepare(std::forward< Args >(args)...));
+        } else {
+            T new_value(std::forward< Args >(args)...); // a throwing constructor must run before any slot is claimed
+            push_prepared(slot_type::prepare(std::move(new_value)));
+        }
+    }
+    void push(T const& new_value) requires std::is_copy_constructible_v< T > { emplace(new_value); }
+    void push(T&& new_value) { emplace(std::move(new_value)); }
+
+    std::optional< T > pop() {
+        counted_node_ptr old_head = head.load(std::memory_order_relaxed);
+        for (Backoff backoff;; backoff.pause()) {
             increase_external_count(head, old_head);
-            node* const ptr = old_head.ptr;
-            if (ptr == tail.load().ptr) { return nullptr; }
+            node* const ptr = old_head.ptr();
+            if (ptr == tail.load().ptr()) {
+                decrease_external_count(head, old_head, ptr);
+                return std::nullopt;
+            }
             counted_node_ptr next = ptr->next.load();
             if (head.compare_exchange_strong(old_head, next)) {
-                T* const res = ptr->data.exchange(nullptr);
+                std::optional< T > res(ptr->data.take());
                 free_external_counter(old_head);
-                return std::unique_ptr< T >(res);
+                return res;
+            }
+            lockfree_stats::add(lockfree_stats::queue_pop_cas_failure);
+            decrease_external_count(head, old_head, ptr);
+        }
+    }
+
+    bool try_pop(T& value) {
+        std::optional< T > res = pop();
+        if (!res) { return false; }
+        value = std::move(*res);
+        return true;
+    }
+};
+
+// Michael-Scott queue: a dummy node at head, push links at tail->next and swings tail, pop swings head.
+// Nodes are reclaimed through a policy of reclaimer.h instead of reference counts, so push and pop are a couple of
+// CASes. pop() protects both head and head->next, and a stale push may still try to link after an unlinked node,
+// so the policy needs two protect slots and must leave the links of retired nodes alone.
+// see more about the technique: Maged Michael and Michael Scott, Simple, fast, and practical non-blocking and
+// blocking concurrent queue algorithms, 1996
+template < class T, class Reclaimer = epoch_reclaimer, class Allocator = default_node_allocator, class Backoff = no_backoff >
+class lock_free_queue_MS {
+    static_assert(Reclaimer::protect_slots >= 2 && Reclaimer::keeps_retired_links, "use lock_free_queue_RC_tail_modified for this scheme");
+    static_assert(std::is_nothrow_move_constructible_v< T >, "a dequeued value must always be moved out");
+    static_assert(std::is_nothrow_move_assignable_v< T >, "a dequeued value must always be moved out");
+
+  private:
+    struct node {
+        std::atomic< node* > next;
+        alignas(T) unsigned char storage[sizeof(T)]; // constructed by push, destroyed by the pop that dequeues it
+
+        node() : next(nullptr) {}
+        template < class... Args >
+        explicit node(std::in_place_t, Args&&... args) : next(nullptr) {
+            ::new (static_cast< void* >(storage)) T(std::forward< Args >(args)...);
+        }
+
+        T* value() { return std::launder(reinterpret_cast< T* >(storage)); }
+    };
+
+    using domain = typename Reclaimer::template domain< node, Allocator >;
+
+    std::atomic< node* >         head;
+    std::atomic< node* >         tail;
+    [[no_unique_address]] domain reclaimer;
+
+    // Unlinks the node after the dummy; the winner moves its value out and that node becomes the new dummy
+    template < class Consume >
+    bool pop_with(Consume consume) {
+        typename domain::guard guard(reclaimer);
+        for (Backoff backoff;; backoff.pause()) {
+            node* old_head   = guard.template protect< 0 >(head, head.load());
+            node* old_tail   = tail.load();
+            node* const next = guard.template protect< 1 >(old_head->next, old_head->next.load());
+            if (old_head != head.load()) { continue; } // old_head may have been retired before next was protected
+            if (old_head == old_tail) {
+                if (!next) { return false; }
+                tail.compare_exchange_strong(old_tail, next); // help a push that has not swung tail yet
+                continue;
+            }
+            if (head.compare_exchange_strong(old_head, next)) {
+                consume(*next->value());
+                next->value()->~T();
+                guard.retire(old_head);
+                return true;
             }
-            ptr->release_ref();
+            lockfree_stats::add(lockfree_stats::queue_pop_cas_failure);
+        }
+    }
+
+  public:
+    lock_free_queue_MS() : head(Allocator::template create< node >()), tail(head.load()) {}
+
+    lock_free_queue_MS(const lock_free_queue_MS&) = delete;
+    lock_free_queue_MS operator=(const lock_free_queue_MS&) = delete;
+
+    ~lock_free_queue_MS() {
+        node* dummy = head.load();
+        while (node* const next = dummy->next.load()) {
+            next->value()->~T();
+            Allocator::destroy(dummy);
+            dummy = next;
         }
+        Allocator::destroy(dummy);
+    }
+
+    template < class... Args >
+    void emplace(Args&&... args) {
+        node* const new_node = Allocator::template create< node >(std::in_place, std::forward< Args >(args)...);
+        typename domain::guard guard(reclaimer);
+        for (Backoff backoff;; backoff.pause()) {
+            node* old_tail = guard.protect(tail, tail.load());
+            node* next     = old_tail->next.load();
+            if (next) {
+                tail.compare_exchange_strong(old_tail, next); // help the push that linked next
+                continue;
+            }
+            if (old_tail->next.compare_exchange_strong(next, new_node)) {
+                tail.compare_exchange_strong(old_tail, new_node);
+                return;
+            }
+            lockfree_stats::add(lockfree_stats::queue_push_cas_failure);
+        }
+    }
+    void push(T const& new_value) requires std::is_copy_constructible_v< T > { emplace(new_value); }
+    void push(T&& new_value) { emplace(std::move(new_value)); }
+
+    std::optional< T > pop() {
+        std::optional< T > res;
+        pop_with([&](T& value) { res.emplace(std::move(value)); });
+        return res;
+    }
+
+    bool try_pop(T& value) {
+        return pop_with([&](T& stored) { value = std::move(stored); });
     }
 };
+
+template < class T, class Allocator = default_node_allocator, class Backoff = no_backoff >
+using lock_free_queue_MS_epoch = lock_free_queue_MS< T, epoch_reclaimer, Allocator, Backoff >;
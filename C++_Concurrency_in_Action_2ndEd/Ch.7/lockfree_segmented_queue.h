@@ -0,0 +1,160 @@
+#pragma once
+
+#include "cache_line.h"
+#include "lockfree_stats.h"
+#include "node_allocator.h"
+#include "reclaimer.h"
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// Unbounded multi-producer, multi-consumer queue over a linked list of fixed-size segments.
+// Producers and consumers claim cells with a fetch_add on the index of their segment, a new segment is allocated and
+// linked only when the last one is full: one allocation per SegmentSize values and no CAS chain per value.
+// A consumer that reaches a cell before its producer marks it taken, and that producer claims another index.
+// Segments are unlinked at head like the nodes of lock_free_queue_MS and reclaimed through a policy of reclaimer.h,
+// a lagging producer may still read the link of an unlinked segment.
+// see more about the technique: Pedro Ramalhete and Andreia Correia, FAAArrayQueue, 2016
+template < class T, class Reclaimer = epoch_reclaimer, class Allocator = new_delete_node_allocator, std::size_t SegmentSize = 1024 >
+class lock_free_queue_segmented {
+    static_assert(Reclaimer::protect_slots >= 1 && Reclaimer::keeps_retired_links, "segments are read after being unlinked");
+    static_assert(std::is_nothrow_move_constructible_v< T >, "a dequeued value must always be moved out");
+    static_assert(SegmentSize > 0);
+
+  private:
+    enum cell_state : unsigned char { empty, claimed, ready, taken };
+
+    struct cell {
+        std::atomic< cell_state > state;
+        alignas(T) unsigned char storage[sizeof(T)];
+
+        cell() : state(empty) {}
+
+        T* value() { return std::launder(reinterpret_cast< T* >(storage)); }
+    };
+
+    struct segment {
+        alignas(cache_line_size) std::atomic< std::size_t > enqueue_index;
+        alignas(cache_line_size) std::atomic< std::size_t > dequeue_index;
+        std::atomic< segment* > next;
+        cell                    cells[SegmentSize];
+
+        segment() : enqueue_index(0), dequeue_index(0), next(nullptr) {}
+        ~segment() {
+            for (cell& c : cells) {
+                if (c.state.load(std::memory_order::relaxed) == ready) { c.value()->~T(); }
+            }
+        }
+    };
+
+    using domain = typename Reclaimer::template domain< segment, Allocator >;
+
+    alignas(cache_line_size) std::atomic< segment* > head;
+    alignas(cache_line_size) std::atomic< segment* > tail;
+    [[no_unique_address]] domain reclaimer;
+
+    template < class... Args >
+    void push_constructed(Args&&... args) {
+        typename domain::guard guard(reclaimer);
+        segment*               spare = nullptr; // allocated for a failed attempt at linking, kept for the next one
+        for (;;) {
+            segment*          old_tail = guard.protect(tail, tail.load());
+            std::size_t const index    = old_tail->enqueue_index.fetch_add(1);
+            if (index < SegmentSize) {
+                cell&      c        = old_tail->cells[index];
+                cell_state expected = empty;
+                if (c.state.compare_exchange_strong(expected, claimed, std::memory_order::acquire)) {
+                    ::new (static_cast< void* >(c.storage)) T(std::forward< Args >(args)...);
+                    c.state.store(ready, std::memory_order::release);
+                    if (spare) { Allocator::destroy(spare); }
+                    return;
+                }
+                lockfree_stats::add(lockfree_stats::queue_push_cas_failure);
+                continue; // a consumer gave up on this cell
+            }
+            if (old_tail != tail.load()) { continue; }
+            segment* next = old_tail->next.load();
+            if (!next) {
+                if (!spare) { spare = Allocator::template create< segment >(); }
+                if (old_tail->next.compare_exchange_strong(next, spare)) {
+                    next  = spare;
+                    spare = nullptr;
+                }
+            }
+            tail.compare_exchange_strong(old_tail, next); // next was linked by this thread or by another one
+        }
+    }
+
+    // Moves the value of the cell at head out through consume, false if the queue is empty
+    template < class Consume >
+    bool pop_with(Consume consume) {
+        typename domain::guard guard(reclaimer);
+        for (;;) {
+            segment* old_head = guard.protect(head, head.load());
+            if (old_head->dequeue_index.load() >= old_head->enqueue_index.load() && !old_head->next.load()) { return false; }
+            std::size_t const index = old_head->dequeue_index.fetch_add(1);
+            if (index < SegmentSize) {
+                cell&      c     = old_head->cells[index];
+                cell_state state = c.state.load(std::memory_order::acquire);
+                if (state == empty && c.state.compare_exchange_strong(state, taken, std::memory_order::acquire)) {
+                    lockfree_stats::add(lockfree_stats::queue_pop_cas_failure);
+                    continue; // the producer is not there yet and will claim another cell
+                }
+                while (state != ready) { // being constructed
+                    std::this_thread::yield();
+                    state = c.state.load(std::memory_order::acquire);
+                }
+                consume(*c.value());
+                c.value()->~T();
+                c.state.store(taken, std::memory_order::relaxed);
+                return true;
+            }
+            segment* const next = old_head->next.load();
+            if (!next) { return false; }
+            segment* old_tail = old_head;
+            tail.compare_exchange_strong(old_tail, next); // tail must not stay on a segment about to be retired
+            if (head.compare_exchange_strong(old_head, next)) { guard.retire(old_head); }
+        }
+    }
+
+  public:
+    lock_free_queue_segmented() : head(Allocator::template create< segment >()), tail(head.load()) {}
+
+    lock_free_queue_segmented(const lock_free_queue_segmented&) = delete;
+    lock_free_queue_segmented operator=(const lock_free_queue_segmented&) = delete;
+
+    ~lock_free_queue_segmented() {
+        segment* s = head.load();
+        while (s) {
+            segment* const next = s->next.load();
+            Allocator::destroy(s);
+            s = next;
+        }
+    }
+
+    template < class... Args >
+    void emplace(Args&&... args) {
+        if constexpr (std::is_nothrow_constructible_v< T, Args... >) {
+            push_constructed(std::forward< Args >(args)...);
+        } else {
+            T new_value(std::forward< Args >(args)...); // a throwing constructor must run before any cell is claimed
+            push_constructed(std::move(new_value));
+        }
+    }
+    void push(T const& new_value) requires std::is_copy_constructible_v< T > { emplace(new_value); }
+    void push(T&& new_value) { emplace(std::move(new_value)); }
+
+    std::optional< T > pop() {
+        std::optional< T > res;
+        pop_with([&](T& value) { res.emplace(std::move(value)); });
+        return res;
+    }
+
+    bool try_pop(T& value) {
+        return pop_with([&](T& stored) { value = std::move(stored); });
+    }
+};
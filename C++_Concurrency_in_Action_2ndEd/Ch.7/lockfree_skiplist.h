@@ -0,0 +1,207 @@
+#pragma once
+
+#include "epoch_domain.h"
+#include "node_allocator.h"
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <utility>
+
+// Lock-free ordered map as a skiplist: each level is a sorted linked list whose links carry a deletion mark in their low
+// bit. Erasing a node marks its upper links, then its link at level 0, which decides among concurrent erasers; searches
+// unlink the marked nodes they meet. find() and for_each() only read and never unlink, they may walk through nodes that
+// are being erased.
+// A node is retired by the last of its inserter and its eraser to finish: an insert still linking the upper levels may
+// make an erased node reachable again, so both run one more search for its key before letting it go.
+// Nodes have room for MaxLevel links whatever their height, so that they all come from one Allocator size class.
+// see more about the technique: Keir Fraser, Practical lock-freedom, 2004
+//                               Maurice Herlihy and Nir Shavit, The art of multiprocessor programming, 14.4
+template < class Key, class Value, class Compare = std::less< Key >, class Allocator = default_node_allocator, unsigned MaxLevel = 16 >
+class lock_free_skiplist {
+    static_assert(MaxLevel > 0 && MaxLevel <= 32);
+
+  protected:
+    using link = std::atomic< std::uintptr_t >;
+
+    inline static std::uintptr_t const marked_bit = 1;
+
+    struct node {
+        Key const               key;
+        Value                   value; // written only by the thread that erased the node, see lock_free_priority_queue
+        unsigned const          height;
+        std::atomic< unsigned > owners; // inserter and eraser, the second one to finish retires the node
+        link                    next[MaxLevel];
+
+        template < class... Args >
+        node(unsigned height_, Key const& key_, Args&&... args) : key(key_), value(std::forward< Args >(args)...), height(height_), owners(2) {}
+    };
+
+    static node*          to_node(std::uintptr_t word) { return reinterpret_cast< node* >(word & ~marked_bit); }
+    static std::uintptr_t to_word(node* n) { return reinterpret_cast< std::uintptr_t >(n); }
+    static bool           is_marked(std::uintptr_t word) { return word & marked_bit; }
+
+    link                          head[MaxLevel];
+    [[no_unique_address]] Compare less;
+
+    // xorshift32, one generator per thread
+    static std::uint32_t random_bits() {
+        thread_local std::uint32_t state = static_cast< std::uint32_t >(std::hash< std::thread::id > {}(std::this_thread::get_id())) | 1;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+    // Level l + 1 has half as many nodes as level l
+    static unsigned random_height() { return 1 + std::countr_zero(random_bits() | (std::uint32_t(1) << (MaxLevel - 1))); }
+
+    bool equivalent(Key const& a, Key const& b) const { return !less(a, b) && !less(b, a); }
+
+    // One attempt at filling preds and succs with the neighbours of key on each level: preds[l] holds the links of the
+    // last node before key (or head) and succs[l] the first node not before it. nullopt if an unlink lost a race.
+    std::optional< bool > try_locate(Key const& key, link** preds, node** succs) {
+        link* pred = head;
+        for (unsigned level = MaxLevel; level-- > 0;) {
+            node* curr = to_node(pred[level].load());
+            while (curr) {
+                std::uintptr_t succ = curr->next[level].load();
+                while (is_marked(succ)) { // unlink curr
+                    std::uintptr_t expected = to_word(curr);
+                    if (!pred[level].compare_exchange_strong(expected, succ & ~marked_bit)) { return std::nullopt; }
+                    curr = to_node(succ);
+                    if (!curr) { break; }
+                    succ = curr->next[level].load();
+                }
+                if (!curr || !less(curr->key, key)) { break; }
+                pred = curr->next;
+                curr = to_node(succ);
+            }
+            preds[level] = pred;
+            succs[level] = curr;
+        }
+        return succs[0] && !less(key, succs[0]->key);
+    }
+    bool locate(Key const& key, link** preds, node** succs) {
+        for (;;) {
+            if (std::optional< bool > const found = try_locate(key, preds, succs)) { return *found; }
+        }
+    }
+
+    void release(node* n) {
+        if (n->owners.fetch_sub(1) == 1) { epoch_domain::retire< Allocator >(n); }
+    }
+
+    // Links the levels above 0 of n, just inserted at level 0, unless it gets erased meanwhile
+    void link_upper_levels(node* n, link** preds, node** succs) {
+        for (unsigned level = 1; level < n->height; ++level) {
+            for (;;) {
+                std::uintptr_t next = n->next[level].load();
+                if (is_marked(next)) { break; }
+                if (next != to_word(succs[level]) && !n->next[level].compare_exchange_strong(next, to_word(succs[level]))) { continue; }
+                std::uintptr_t expected = to_word(succs[level]);
+                if (preds[level][level].compare_exchange_strong(expected, to_word(n))) { break; }
+                if (!locate(n->key, preds, succs) || succs[0] != n) { break; }
+            }
+            if (is_marked(n->next[0].load())) { break; }
+        }
+        if (is_marked(n->next[0].load())) { locate(n->key, preds, succs); } // the eraser may have searched before a link made here
+        release(n);
+    }
+
+    // Erases n if no other thread did it first. Call within an epoch_domain::guard; n stays readable until the guard ends.
+    // The upper links are marked first: once level 0 is marked no search stops at n on an upper level and hands it out
+    // as the level 0 predecessor, whose marked link would fail every insert CAS until the eraser got to the upper levels.
+    bool remove(node* n) {
+        for (unsigned level = n->height; level-- > 1;) { n->next[level].fetch_or(marked_bit); }
+        if (is_marked(n->next[0].fetch_or(marked_bit))) { return false; }
+        link* preds[MaxLevel];
+        node* succs[MaxLevel];
+        locate(n->key, preds, succs);
+        release(n);
+        return true;
+    }
+
+    // Last node before key on level 0, nullptr for head, without unlinking anything
+    node* find_before(Key const& key) const {
+        link const* pred      = head;
+        node*       pred_node = nullptr;
+        for (unsigned level = MaxLevel; level-- > 0;) {
+            for (node* curr = to_node(pred[level].load()); curr && less(curr->key, key); curr = to_node(curr->next[level].load())) {
+                pred      = curr->next;
+                pred_node = curr;
+            }
+        }
+        return pred_node;
+    }
+
+  public:
+    lock_free_skiplist() {
+        for (link& l : head) { l.store(0, std::memory_order::relaxed); }
+    }
+
+    lock_free_skiplist(const lock_free_skiplist&) = delete;
+    lock_free_skiplist operator=(const lock_free_skiplist&) = delete;
+
+    ~lock_free_skiplist() {
+        for (node* n = to_node(head[0].load()); n;) {
+            node* const next = to_node(n->next[0].load());
+            Allocator::destroy(n);
+            n = next;
+        }
+    }
+
+    // true if key was inserted, false if it was already there
+    template < class... Args >
+    bool emplace(Key const& key, Args&&... args) {
+        epoch_domain::guard critical_section;
+        link*               preds[MaxLevel];
+        node*               succs[MaxLevel];
+        node*               new_node = nullptr;
+        for (;;) {
+            if (locate(key, preds, succs)) {
+                if (new_node) { Allocator::destroy(new_node); }
+                return false;
+            }
+            if (!new_node) { new_node = Allocator::template create< node >(random_height(), key, std::forward< Args >(args)...); }
+            for (unsigned level = 0; level < new_node->height; ++level) { new_node->next[level].store(to_word(succs[level]), std::memory_order::relaxed); }
+            std::uintptr_t expected = to_word(succs[0]);
+            if (preds[0][0].compare_exchange_strong(expected, to_word(new_node))) { break; }
+        }
+        link_upper_levels(new_node, preds, succs);
+        return true;
+    }
+    bool insert(Key const& key, Value const& value) { return emplace(key, value); }
+
+    bool erase(Key const& key) {
+        epoch_domain::guard critical_section;
+        link*               preds[MaxLevel];
+        node*               succs[MaxLevel];
+        for (;;) {
+            if (!locate(key, preds, succs)) { return false; }
+            if (remove(succs[0])) { return true; }
+        }
+    }
+
+    std::optional< Value > find(Key const& key) const {
+        epoch_domain::guard critical_section;
+        node* const         pred = find_before(key);
+        node* const         n    = to_node((pred ? pred->next : head)[0].load());
+        if (!n || !equivalent(n->key, key) || is_marked(n->next[0].load())) { return std::nullopt; }
+        return n->value;
+    }
+    bool contains(Key const& key) const { return find(key).has_value(); }
+
+    // visit(key, value) in key order for the keys in [first, last), as they are while the walk passes them
+    template < class Visitor >
+    void for_each(Key const& first, Key const& last, Visitor visit) const {
+        epoch_domain::guard critical_section;
+        node* const         pred = find_before(first);
+        for (node* n = to_node((pred ? pred->next : head)[0].load()); n && less(n->key, last);) {
+            std::uintptr_t const next = n->next[0].load();
+            if (!is_marked(next)) { visit(n->key, n->value); }
+            n = to_node(next);
+        }
+    }
+};
@@ -1,11 +1,20 @@
 #pragma once
 
+#include "backoff.h"
+#include "counted_node_ptr.h"
+#include "elimination_array.h"
+#include "hazard_pointer_domain.h"
+#include "lockfree_stats.h"
+#include "node_allocator.h"
+#include "reclaimer.h"
 #include <atomic>
-#include <functional>
 #include <memory>
-#include <thread>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-template < class T >
+template < class T, class Allocator >
 class stack_data {
   public:
     struct node {
@@ -17,277 +26,311 @@ class stack_data {
     };
 };
 
-template < class T >
-class stack_push : public stack_data< T > {
+template < class T, class Allocator, class Backoff >
+class stack_push : public stack_data< T, Allocator > {
   protected:
-    using stack_data< T >::node;
+    using typename stack_data< T, Allocator >::node;
 
     std::atomic< node* > head;
     stack_push() = default;
 
+    // Puts back a chain detached from head, used when pop_all() cannot hand it out
+    void splice(node* top) {
+        node* bottom = top;
+        while (bottom->next) { bottom = bottom->next; }
+        bottom->next = head.load(std::memory_order::relaxed);
+        Backoff backoff;
+        while (!head.compare_exchange_weak(bottom->next, top, std::memory_order::release, std::memory_order::relaxed)) {
+            lockfree_stats::add(lockfree_stats::stack_push_cas_failure);
+            backoff.pause();
+        }
+    }
+
+    // A single attempt at publishing new_node, for callers that do something else than retrying when head is contended
+    bool try_link(node* new_node) {
+        new_node->next = head.load(std::memory_order::relaxed);
+        return head.compare_exchange_strong(new_node->next, new_node, std::memory_order::release, std::memory_order::relaxed);
+    }
+
   public:
+    // Publishing a node only needs release: what pop() does with head is up to the reclamation scheme, which keeps its
+    // own orderings (listings 7.4 and 7.6 rely on seq_cst between unlinking a node and checking who may still read it)
     void push(T const& data) {
-        node* const new_node = new node(data);
-        new_node->next       = head.load();
-        while (!head.compare_exchange_weak(new_node->next, new_node))
-            ; // if head was changed by another thread, update new_node->next with new head value
+        node* const new_node = Allocator::template create< node >(data);
+        new_node->next       = head.load(std::memory_order::relaxed);
+        Backoff backoff;
+        // if head was changed by another thread, update new_node->next with new head value
+        while (!head.compare_exchange_weak(new_node->next, new_node, std::memory_order::release, std::memory_order::relaxed)) {
+            lockfree_stats::add(lockfree_stats::stack_push_cas_failure);
+            backoff.pause();
+        }
     }
     void push(T&& data) {
-        node* const new_node = new node(std::move(data));
-        new_node->next       = head.load();
-        while (!head.compare_exchange_weak(new_node->next, new_node))
-            ; // if head was changed by another thread, update new_node->next with new head value
+        node* const new_node = Allocator::template create< node >(std::move(data));
+        new_node->next       = head.load(std::memory_order::relaxed);
+        Backoff backoff;
+        // if head was changed by another thread, update new_node->next with new head value
+        while (!head.compare_exchange_weak(new_node->next, new_node, std::memory_order::release, std::memory_order::relaxed)) {
+            lockfree_stats::add(lockfree_stats::stack_push_cas_failure);
+            backoff.pause();
+        }
+    }
+
+    // Same order as pushing the values one by one, but the chain is built privately and published with one CAS
+    template < class InputIt >
+    void push_range(InputIt first, InputIt last) {
+        if (first == last) { return; }
+        node* const bottom = Allocator::template create< node >(*first);
+        node*       top    = bottom;
+        try {
+            for (++first; first != last; ++first) {
+                node* const new_node = Allocator::template create< node >(*first);
+                new_node->next       = top;
+                top                  = new_node;
+            }
+        } catch (...) {
+            while (top) {
+                node* const next = top->next;
+                Allocator::destroy(top);
+                top = next;
+            }
+            throw;
+        }
+        bottom->next = head.load(std::memory_order::relaxed);
+        Backoff backoff;
+        while (!head.compare_exchange_weak(bottom->next, top, std::memory_order::release, std::memory_order::relaxed)) {
+            lockfree_stats::add(lockfree_stats::stack_push_cas_failure);
+            backoff.pause();
+        }
     }
 };
 
-// Listing 7.2 Implementing push() without locks - leaking nodes
-template < class T >
-class lock_free_stack_7_2 : public stack_push< T > {
+// Listings 7.2, 7.4 and 7.6 differ only in how pop() protects head and what it does with the node it unlinked,
+// so a single stack takes the memory reclamation scheme as a policy, see reclaimer.h.
+// Backoff is what a thread does after losing a CAS on head, see backoff.h
+template < class T, class Reclaimer, class Allocator = default_node_allocator, class Backoff = no_backoff >
+class lock_free_stack : public stack_push< T, Allocator, Backoff > {
+  protected:
+    using typename stack_data< T, Allocator >::node;
+
   private:
-    using stack_data< T >::node;
-    using stack_push< T >::head;
+    using stack_push< T, Allocator, Backoff >::head;
+    using domain = typename Reclaimer::template domain< node, Allocator >;
 
-  public:
-    std::shared_ptr< T > pop() {
-        node* old_head = head.load();
-        while (old_head && !head.compare_exchange_weak(old_head, old_head->next))
-            ;
-        return old_head ? old_head->data : nullptr;
-    }
+    [[no_unique_address]] domain reclaimer;
+
+  protected:
+    // A single attempt at unlinking head: std::nullopt if another thread changed head first,
+    // an empty pointer if the stack was empty
+    std::optional< std::shared_ptr< T > > try_pop_once() {
+        typename domain::guard guard(reclaimer);
+
+        node* old_head = guard.protect(head, head.load());
+        if (!old_head) { return std::shared_ptr< T >(); }
+        if (!head.compare_exchange_strong(old_head, old_head->next)) {
+            lockfree_stats::add(lockfree_stats::stack_pop_cas_failure);
+            return std::nullopt;
+        }
 
-    ~lock_free_stack_7_2() {
-        while (!pop()) {}
+        std::shared_ptr< T > res;
+        res.swap(old_head->data);
+        guard.retire(old_head);
+        return res;
     }
-};
 
-// Listing 7.5 The reference-counted reclamation machinery
-template < class T >
-class ref_count_delete_machinery : protected stack_data< T > {
   public:
-    using stack_data< T >::node;
+    lock_free_stack() = default;
 
-    std::atomic< node* >    to_delete;
-    std::atomic< unsigned > threads_in_pop;
+    lock_free_stack(const lock_free_stack&) = delete;
+    lock_free_stack operator=(const lock_free_stack&) = delete;
 
-    static void delete_nodes(node* nodes) {
-        while (nodes) {
-            node* next = nodes->next;
-            delete nodes;
-            nodes = next;
+    ~lock_free_stack() {
+        while (node* const old_head = head.load()) {
+            head.store(old_head->next);
+            Allocator::destroy(old_head);
         }
     }
 
-    void try_reclaim(node* old_head) {
-        if (threads_in_pop == 1) {
-            node* nodes_to_delete = to_delete.exchange(nullptr);
-            if (!--threads_in_pop) {
-                delete_nodes(nodes_to_delete);
-            } else if (nodes_to_delete) {
-                chain_pending_nodes(nodes_to_delete);
-            }
-            delete old_head;
-        } else {
-            chain_pending_node(old_head);
-            --threads_in_pop;
-        }
-    }
-    void chain_pending_nodes(node* nodes) {
-        node* last = nodes;
-        while (node* const next = last->next) { last = next; }
-        chain_pending_nodes(nodes, last);
-    }
-    void chain_pending_nodes(node* first, node* last) {
-        last->next = to_delete;
-        while (!to_delete.compare_exchange_weak(last->next, first))
-            ;
-    }
-    void chain_pending_node(node* n) { chain_pending_nodes(n, n); }
-};
+    std::shared_ptr< T > pop() {
+        typename domain::guard guard(reclaimer);
 
-// Listing 7.4 Reclaiming nodes when no threads are in pop()
-template < class T >
-class lock_free_stack_7_4 : private ref_count_delete_machinery< T >, public stack_push< T > {
-  private:
-    using stack_data< T >::node;
-    using stack_push< T >::head;
-    using ref_count_delete_machinery< T >::threads_in_pop;
-    using ref_count_delete_machinery< T >::try_reclaim;
+        node* old_head = guard.protect(head, head.load());
+        for (Backoff backoff; old_head && !head.compare_exchange_weak(old_head, old_head->next);) {
+            lockfree_stats::add(lockfree_stats::stack_pop_cas_failure);
+            backoff.pause();
+            old_head = guard.protect(head, old_head);
+        }
 
-  public:
-    std::shared_ptr< T > pop() {
-        ++threads_in_pop;
-        node* old_head = head.load();
-        while (old_head && !head.compare_exchange_weak(old_head, old_head->next))
-            ;
         std::shared_ptr< T > res;
-        if (old_head) { res.swap(old_head->data); }
-
-        try_reclaim(old_head);
+        if (old_head) {
+            res.swap(old_head->data);
+            guard.retire(old_head);
+        }
         return res;
     }
 
-    ~lock_free_stack_7_4() {
-        while (!pop()) {}
+    // Detaches the whole stack with one exchange, values come out in pop() order
+    std::vector< std::shared_ptr< T > > pop_all() {
+        typename domain::guard guard(reclaimer);
+        node* const            old_head = head.exchange(nullptr);
+
+        std::vector< std::shared_ptr< T > > res;
+        std::size_t                         count = 0;
+        for (node* n = old_head; n; n = n->next) { ++count; }
+        try {
+            res.reserve(count);
+        } catch (...) {
+            if (old_head) { this->splice(old_head); }
+            throw;
+        }
+        for (node* n = old_head; n;) {
+            node* const next = n->next; // read before retire(), which may reuse the link
+            res.push_back(std::move(n->data));
+            guard.retire(n);
+            n = next;
+        }
+        return res;
     }
 };
 
-// Listing 7.7 A simple implementation of get_hazard_pointer_for_current_thread()
-// This technique is patented by IBM, and can only be used under GPL or with a licensing arrangement
-template < class T >
-class hazardous_pointer_machinery {
+// lock_free_stack with an elimination_array in front of head: a push and a pop that both lost their CAS can pair up
+// in the array instead of retrying on head. A node handed over this way was never reachable from head, so the popper
+// frees it directly, only nodes that went through head are retired to the reclamation policy.
+// Under balanced push/pop load the array keeps throughput growing with the thread count where the plain stack
+// flattens, under one-sided load offers time out and the cost is the patience of the pushers.
+template < class T, class Reclaimer = epoch_reclaimer, class Allocator = default_node_allocator, unsigned Slots = 8 >
+class lock_free_stack_elimination : public lock_free_stack< T, Reclaimer, Allocator > {
   private:
-    inline static unsigned const max_hazard_pointers = 100;
-    struct hazard_pointer {
-        std::atomic< std::thread::id > id;
-        std::atomic< void* >           pointer;
-    };
-    inline static hazard_pointer hazard_pointers[max_hazard_pointers];
+    using typename lock_free_stack< T, Reclaimer, Allocator >::node;
 
-    class hp_owner {
-        hazard_pointer* hp;
+    elimination_array< node, Slots > exchanger;
 
-      public:
-        hp_owner(hp_owner const&) = delete;
-        hp_owner operator=(hp_owner const&) = delete;
+    void push_node(node* new_node) {
+        while (!this->try_link(new_node)) {
+            lockfree_stats::add(lockfree_stats::stack_push_cas_failure);
+            if (exchanger.offer(new_node)) { return; }
+        }
+    }
 
-        hp_owner() : hp(nullptr) {
-            for (unsigned i = 0; i < max_hazard_pointers; ++i) {
-                std::thread::id old_id;
-                if (hazard_pointers[i].id.compare_exchange_strong(old_id, std::this_thread::get_id())) {
-                    hp = &hazard_pointers[i];
-                    break;
-                }
+  public:
+    lock_free_stack_elimination() = default;
+
+    void push(T const& data) { push_node(Allocator::template create< node >(data)); }
+    void push(T&& data) { push_node(Allocator::template create< node >(std::move(data))); }
+
+    std::shared_ptr< T > pop() {
+        for (;;) {
+            if (std::optional< std::shared_ptr< T > > res = this->try_pop_once()) { return std::move(*res); }
+            if (node* const offered = exchanger.take()) {
+                std::shared_ptr< T > res;
+                res.swap(offered->data);
+                Allocator::destroy(offered);
+                return res;
             }
-            if (!hp) { throw std::runtime_error("No hazard pointers available"); }
         }
+    }
+};
 
-        ~hp_owner() {
-            hp->pointer.store(nullptr);
-            hp->id.store(std::thread::id());
-        }
+template < class T, class Allocator >
+class stack_inline_data {
+  public:
+    struct node {
+        T     data;
+        node* next;
 
-        std::atomic< void* >& get_pointer() { return hp->pointer; }
+        template < class... Args >
+        explicit node(std::in_place_t, Args&&... args) : data(std::forward< Args >(args)...), next(nullptr) {}
     };
+};
 
-    template < class T >
-    static void do_delete(void* p) {
-        delete static_cast< T* >(p);
-    }
-    struct data_to_reclaim {
-        void*                        data;
-        std::function< void(void*) > deleter;
-        data_to_reclaim*             next;
+// Listing 7.6 with the value stored directly in the node: no shared_ptr control block per element and
+// move-only types are supported. pop() hands the value out by value instead of through a shared_ptr.
+// Nodes are reclaimed through hazard_pointer_domain, like lock_free_stack_hazard_domain.
+template < class T, class Allocator = default_node_allocator, class Backoff = no_backoff >
+class lock_free_stack_inline : public stack_inline_data< T, Allocator > {
+  private:
+    using typename stack_inline_data< T, Allocator >::node;
 
-        template < class T >
-        data_to_reclaim(T* p) : data(p), deleter(&do_delete< T >), next(nullptr) {}
+    std::atomic< node* > head;
 
-        ~data_to_reclaim() { deleter(data); }
-    };
-    std::atomic< data_to_reclaim* > nodes_to_reclaim;
-    void                            add_to_reclaim_list(data_to_reclaim* node) {
-        node->next = nodes_to_reclaim.load();
-        while (!nodes_to_reclaim.compare_exchange_weak(node->next, node))
-            ;
-    }
+    node* pop_head() {
+        hazard_pointer_domain::guard hp;
 
-  public:
-    std::atomic< void* >& get_hazard_pointer_for_current_thread() {
-        thread_local static hp_owner hazard {};
-        return hazard.get_pointer();
-    }
-    bool outstanding_hazard_pointers_for(void* p) {
-        for (unsigned i = 0; i < max_hazard_pointers; ++i) {
-            if (hazard_pointers[i].pointer.load() == p) { return true; }
+        node* old_head = hp.protect(head);
+        for (Backoff backoff; old_head && !head.compare_exchange_strong(old_head, old_head->next);) {
+            lockfree_stats::add(lockfree_stats::stack_pop_cas_failure);
+            backoff.pause();
+            old_head = hp.protect(head);
         }
-        return false;
+        return old_head;
     }
-    template < class T >
-    void reclaim_later(T* data) {
-        add_to_reclaim_list(new data_to_reclaim(data));
-    }
-    void delete_nodes_with_no_hazards() {
-        data_to_reclaim* current = nodes_to_reclaim.exchange(nullptr);
-        while (current) {
-            data_to_reclaim* const next = current->next;
-            if (!outstanding_hazard_pointers_for(current->data)) {
-                delete current;
-            } else {
-                add_to_reclaim_list(current);
-            }
-            current = next;
+
+  public:
+    lock_free_stack_inline() : head(nullptr) {}
+
+    lock_free_stack_inline(const lock_free_stack_inline&) = delete;
+    lock_free_stack_inline operator=(const lock_free_stack_inline&) = delete;
+
+    ~lock_free_stack_inline() {
+        while (node* const old_head = head.load()) {
+            head.store(old_head->next);
+            Allocator::destroy(old_head);
         }
     }
-};
-
-// Listing 7.6 An implementation of pop() using hazard pointers
-template < class T >
-class lock_free_stack_7_6 : private hazardous_pointer_machinery< T >, public stack_push< T > {
-  private:
-    using stack_data< T >::node;
-    using stack_push< T >::head;
-    using hazardous_pointer_machinery< T >::get_hazard_pointer_for_current_thread;
-    using hazardous_pointer_machinery< T >::outstanding_hazard_pointers_for;
-    using hazardous_pointer_machinery< T >::reclaim_later;
-    using hazardous_pointer_machinery< T >::delete_nodes_with_no_hazards;
 
-  public:
-    std::shared_ptr< T > pop() {
-        std::atomic< void* >& hp = get_hazard_pointer_for_current_thread();
-
-        node* old_head = head.load();
-        do {
-            node* temp;
-            do {
-                temp = old_head;
-                hp.store(old_head);
-                old_head = head.load();
-            } while (old_head != temp);
-        } while (old_head && !head.compare_exchange_strong(old_head, old_head->next));
-
-        hp.store(nullptr);
-        std::shared_ptr< T > res;
-        if (old_head) {
-            res.swap(old_head->data);
-            if (outstanding_hazard_pointers_for(old_head)) {
-                reclaim_later(old_head);
-            } else {
-                delete old_head;
-            }
-            delete_nodes_with_no_hazards();
+    template < class... Args >
+    void emplace(Args&&... args) {
+        node* const new_node = Allocator::template create< node >(std::in_place, std::forward< Args >(args)...);
+        new_node->next       = head.load(std::memory_order::relaxed);
+        Backoff backoff;
+        while (!head.compare_exchange_weak(new_node->next, new_node, std::memory_order::release, std::memory_order::relaxed)) {
+            lockfree_stats::add(lockfree_stats::stack_push_cas_failure);
+            backoff.pause();
         }
+    }
+    void push(T const& data) requires std::is_copy_constructible_v< T > { emplace(data); }
+    void push(T&& data) { emplace(std::move(data)); }
+
+    // Only the thread that unlinked old_head reads its data, so the value can be moved out before retiring the node
+    std::optional< T > pop() {
+        node* const old_head = pop_head();
+        if (!old_head) { return std::nullopt; }
+        std::optional< T > res(std::move(old_head->data));
+        hazard_pointer_domain::retire< Allocator >(old_head);
         return res;
     }
 
-    ~lock_free_stack_7_6() {
-        while (!pop()) {}
+    bool try_pop(T& value) {
+        node* const old_head = pop_head();
+        if (!old_head) { return false; }
+        value = std::move(old_head->data);
+        hazard_pointer_domain::retire< Allocator >(old_head);
+        return true;
     }
 };
 
-template < class T >
+template < class T, class Allocator, class CountedPtr >
 class stack_ref_counted_data {
   public:
     struct node;
 
-    struct counted_node_ptr {
-        int   external_count;
-        node* ptr;
-    };
+    using counted_node_ptr = typename CountedPtr::template type< node >;
 
     struct node {
         std::shared_ptr< T > data;
         std::atomic< int >   internal_count;
         counted_node_ptr     next;
 
-        node(T const& data_) : data(std::make_shared< T >(data_)), internal_count(0), next(nullptr) {}
+        node(T const& data_) : data(std::make_shared< T >(data_)), internal_count(0), next {} {}
     };
 };
 
 // Listing 7.10 Pushing a node on a lock-free stack using split reference counts
-template < class T >
-class stack_ref_counted_push : public stack_ref_counted_data< T > {
+template < class T, class Allocator, class Backoff, class CountedPtr >
+class stack_ref_counted_push : public stack_ref_counted_data< T, Allocator, CountedPtr > {
   protected:
-    using stack_ref_counted_data< T >::counted_node_ptr;
-    using stack_ref_counted_data< T >::node;
+    using typename stack_ref_counted_data< T, Allocator, CountedPtr >::counted_node_ptr;
+    using typename stack_ref_counted_data< T, Allocator, CountedPtr >::node;
 
     stack_ref_counted_push() = default;
 
@@ -295,58 +338,149 @@ class stack_ref_counted_push : public stack_ref_counted_data< T > {
     std::atomic< counted_node_ptr > head;
 
     void push(T const& data) {
-        counted_node_ptr new_node;
-        new_node.ptr            = new node(data);
-        new_node.external_count = 1;
-        new_node.ptr->next      = head.load(std::memory_order::relaxed);
-        while (!head.compare_exchange_weak(new_node.ptr->next, new_node, std::memory_order::release, std::memory_order::relaxed))
-            ;
+        counted_node_ptr new_node(1, Allocator::template create< node >(data));
+        new_node.ptr()->next = head.load(std::memory_order::relaxed);
+        Backoff backoff;
+        while (!head.compare_exchange_weak(new_node.ptr()->next, new_node, std::memory_order::release, std::memory_order::relaxed)) {
+            lockfree_stats::add(lockfree_stats::stack_push_cas_failure);
+            backoff.pause();
+        }
+    }
+
+    // Every link of the private chain carries the external count of 1 a single push() would give it
+    template < class InputIt >
+    void push_range(InputIt first, InputIt last) {
+        if (first == last) { return; }
+        node* const      bottom = Allocator::template create< node >(*first);
+        counted_node_ptr top(1, bottom);
+        try {
+            for (++first; first != last; ++first) {
+                node* const new_node = Allocator::template create< node >(*first);
+                new_node->next       = top;
+                top.set_ptr(new_node);
+            }
+        } catch (...) {
+            for (node* n = top.ptr(); n;) {
+                node* const next = n->next.ptr();
+                Allocator::destroy(n);
+                n = next;
+            }
+            throw;
+        }
+        bottom->next = head.load(std::memory_order::relaxed);
+        Backoff backoff;
+        while (!head.compare_exchange_weak(bottom->next, top, std::memory_order::release, std::memory_order::relaxed)) {
+            lockfree_stats::add(lockfree_stats::stack_push_cas_failure);
+            backoff.pause();
+        }
     }
 };
 
 // Listing 7.11 Popping a node from a lock-free stack using split reference counts
-template < class T >
-class lock_free_stack_7_11 : public stack_ref_counted_push< T > {
+template < class T, class Allocator, class Backoff, class CountedPtr >
+class lock_free_stack< T, basic_split_ref_count_reclaimer< CountedPtr >, Allocator, Backoff >
+    : public stack_ref_counted_push< T, Allocator, Backoff, CountedPtr > {
   private:
-    using stack_ref_counted_push< T >::counted_node_ptr;
-    using stack_ref_counted_push< T >::node;
-    using stack_ref_counted_push< T >::head;
+    using typename stack_ref_counted_push< T, Allocator, Backoff, CountedPtr >::counted_node_ptr;
+    using typename stack_ref_counted_push< T, Allocator, Backoff, CountedPtr >::node;
+    using stack_ref_counted_push< T, Allocator, Backoff, CountedPtr >::head;
 
     void increase_head_count(counted_node_ptr& old_counter) {
         counted_node_ptr new_counter;
-        do {
+        for (Backoff backoff;; backoff.pause()) {
             new_counter = old_counter;
-            ++new_counter.external_count;
-        } while (!head.compare_exchange_strong(old_counter, new_counter, std::memory_order::acquire, std::memory_order::relaxed));
-        old_counter.external_count = new_counter.external_count;
+            new_counter.set_external_count(old_counter.external_count() + 1);
+            if (head.compare_exchange_strong(old_counter, new_counter, std::memory_order::acquire, std::memory_order::relaxed)) { break; }
+            lockfree_stats::add(lockfree_stats::stack_pop_cas_failure);
+        }
+        old_counter = new_counter;
     }
 
   public:
-    lock_free_stack_7_11() : stack_ref_counted_push< T >() {}
+    lock_free_stack() : stack_ref_counted_push< T, Allocator, Backoff, CountedPtr >() {}
+
+    lock_free_stack(const lock_free_stack&) = delete;
+    lock_free_stack operator=(const lock_free_stack&) = delete;
 
     std::shared_ptr< T > pop() {
         counted_node_ptr old_head = head.load(std::memory_order::relaxed);
-        for (;;) {
+        for (Backoff backoff;; backoff.pause()) {
             increase_head_count(old_head);
-            node* const ptr = old_head.ptr;
+            node* const ptr = old_head.ptr();
             if (!ptr) { return nullptr; }
-            if (head.compare_exchange_strong(old_head, ptr->next, std::memory_order::relaxed)) {
+            // a CAS that failed only because other threads raised the count leaves our reference counted in old_head,
+            // retrying without taking another one keeps the external count from growing on a contended head
+            while (!head.compare_exchange_strong(old_head, ptr->next, std::memory_order::relaxed) && old_head.ptr() == ptr) {
+                lockfree_stats::add(lockfree_stats::stack_pop_cas_failure);
+                backoff.pause();
+            }
+            if (old_head.ptr() == ptr) {
                 std::shared_ptr< T > res;
                 res.swap(ptr->data);
 
-                int const count_increase = old_head.external_count - 2;
+                int const count_increase = old_head.external_count() - 2;
 
-                if (ptr->internal_count.fetch_add(count_increase, std::memory_order::release) == -count_increase) { delete ptr; }
+                if (ptr->internal_count.fetch_add(count_increase, std::memory_order::release) == -count_increase) { Allocator::destroy(ptr); }
 
                 return res;
             } else if (ptr->internal_count.fetch_sub(1, std::memory_order::relaxed) == 1) {
-                delete ptr;
+                Allocator::destroy(ptr);
             }
         }
     }
 
-    ~lock_free_stack_7_11() {
-        while (!pop())
+    // Detaches the whole stack with one exchange. Each link still carries the external count of the threads that
+    // reached the node through head, so every node is released the way pop() releases the one it took.
+    std::vector< std::shared_ptr< T > > pop_all() {
+        counted_node_ptr current = head.exchange(counted_node_ptr {}, std::memory_order::acquire);
+
+        std::vector< std::shared_ptr< T > > res;
+        std::size_t                         count  = 0;
+        node*                               bottom = nullptr;
+        for (node* n = current.ptr(); n; n = n->next.ptr()) {
+            ++count;
+            bottom = n;
+        }
+        try {
+            res.reserve(count);
+        } catch (...) {
+            if (bottom) {
+                bottom->next = head.load(std::memory_order::relaxed);
+                Backoff backoff;
+                while (!head.compare_exchange_weak(bottom->next, current, std::memory_order::release, std::memory_order::relaxed)) {
+                    lockfree_stats::add(lockfree_stats::stack_push_cas_failure);
+                    backoff.pause();
+                }
+            }
+            throw;
+        }
+        while (node* const ptr = current.ptr()) {
+            counted_node_ptr const next = ptr->next;
+            res.push_back(nullptr);
+            res.back().swap(ptr->data);
+
+            int const count_increase = current.external_count() - 1; // no reference of our own to drop, unlike pop()
+            if (ptr->internal_count.fetch_add(count_increase, std::memory_order::release) == -count_increase) { Allocator::destroy(ptr); }
+            current = next;
+        }
+        return res;
+    }
+
+    ~lock_free_stack() {
+        while (pop())
             ;
     }
 };
+
+template < class T, class Allocator = default_node_allocator, class Backoff = no_backoff >
+using lock_free_stack_7_2 = lock_free_stack< T, leaking_reclaimer, Allocator, Backoff >;
+template < class T, class Allocator = default_node_allocator, class Backoff = no_backoff >
+using lock_free_stack_7_4 = lock_free_stack< T, threads_in_pop_reclaimer, Allocator, Backoff >;
+template < class T, class Allocator = default_node_allocator, class Backoff = no_backoff >
+using lock_free_stack_7_6 = lock_free_stack< T, hazard_pointer_reclaimer, Allocator, Backoff >;
+template < class T, class Allocator = default_node_allocator, class Backoff = no_backoff >
+using lock_free_stack_7_11 = lock_free_stack< T, split_ref_count_reclaimer, Allocator, Backoff >;
+template < class T, class Allocator = default_node_allocator, class Backoff = no_backoff >
+using lock_free_stack_hazard_domain = lock_free_stack< T, hazard_domain_reclaimer, Allocator, Backoff >;
+template < class T, class Allocator = default_node_allocator, class Backoff = no_backoff >
+using lock_free_stack_epoch = lock_free_stack< T, epoch_reclaimer, Allocator, Backoff >;
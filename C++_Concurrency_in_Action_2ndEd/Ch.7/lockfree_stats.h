@@ -0,0 +1,111 @@
+#pragma once
+
+#include "cache_line.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+// Contention and reclamation counters of the containers of this chapter, compiled in with -DLOCKFREE_STATS
+// (cmake -DLOCKFREE_STATS=ON). Without it lockfree_stats::add() is an empty inline function and nothing is counted.
+// Each thread counts into its own cache lines with plain relaxed stores; take_snapshot() sums the live threads and the
+// totals left by exited ones, so its figures are exact once the counted operations have completed.
+// Backlogs are differences of two counters, e.g. retired - reclaimed is the length of the retire lists.
+#ifdef LOCKFREE_STATS
+inline constexpr bool lockfree_stats_enabled = true;
+#else
+inline constexpr bool lockfree_stats_enabled = false;
+#endif
+
+class lockfree_stats {
+  public:
+    enum event : unsigned {
+        stack_push_cas_failure, // compare_exchange on head lost by push(), push_range() and the elimination stack
+        stack_pop_cas_failure,
+        queue_push_cas_failure, // compare_exchange on tail or on tail->next lost by push()
+        queue_pop_cas_failure,
+        pending_chained,   // nodes put on to_delete by threads_in_pop_reclaimer, listing 7.4
+        pending_freed,     // nodes freed from to_delete
+        reclaim_deferred,  // nodes put on nodes_to_reclaim by hazard_pointer_reclaimer, listing 7.6
+        reclaim_freed,     // nodes freed from nodes_to_reclaim
+        hazard_scans,      // scans of every hazard slot, by the machinery of listing 7.6 or by hazard_pointer_domain
+        hp_owner_claimed,  // hazard slots claimed by an hp_owner of listing 7.7, claimed - released are in use
+        hp_owner_released,
+        hp_owner_probes,   // hazard records tried before finding a free one, see hazard_pointer_registry
+        retired,           // nodes retired to hazard_pointer_domain or epoch_domain
+        reclaimed,         // nodes they freed
+        epoch_advances,
+        event_count
+    };
+
+    struct snapshot {
+        std::uint64_t values[event_count];
+
+        std::uint64_t operator[](event e) const { return values[e]; }
+    };
+
+    static char const* name(event e) {
+        static char const* const names[event_count] = { "stack_push_cas_failure", "stack_pop_cas_failure", "queue_push_cas_failure",
+                                                        "queue_pop_cas_failure",  "pending_chained",       "pending_freed",
+                                                        "reclaim_deferred",       "reclaim_freed",         "hazard_scans",
+                                                        "hp_owner_claimed",       "hp_owner_released",     "hp_owner_probes",
+                                                        "retired",                "reclaimed",             "epoch_advances" };
+        return names[e];
+    }
+
+  private:
+    struct alignas(cache_line_size) thread_counters {
+        std::atomic< std::uint64_t > values[event_count] = {};
+        thread_counters*             next                 = nullptr;
+    };
+
+    inline static std::mutex       registry_mutex;
+    inline static thread_counters* live = nullptr; // registered threads
+    inline static snapshot         exited {};      // totals of the threads that exited
+
+    // Registers the counters of its thread, folds them into exited when the thread ends
+    class registration {
+        thread_counters& counters;
+
+      public:
+        explicit registration(thread_counters& c) : counters(c) {
+            std::lock_guard< std::mutex > lock(registry_mutex);
+            counters.next = live;
+            live          = &counters;
+        }
+        ~registration() {
+            std::lock_guard< std::mutex > lock(registry_mutex);
+            for (unsigned e = 0; e < event_count; ++e) { exited.values[e] += counters.values[e].load(std::memory_order::relaxed); }
+            thread_counters** link = &live;
+            while (*link != &counters) { link = &(*link)->next; }
+            *link = counters.next;
+        }
+
+        registration(registration const&) = delete;
+        registration operator=(registration const&) = delete;
+    };
+
+    // The counters outlive the registration: destructors of other thread_local objects running later still find
+    // them, what they count then is lost
+    static thread_counters& local_counters() {
+        thread_local thread_counters counters;
+        thread_local registration    registered(counters);
+        return counters;
+    }
+
+  public:
+    static void add([[maybe_unused]] event e, [[maybe_unused]] std::uint64_t n = 1) {
+        if constexpr (lockfree_stats_enabled) {
+            std::atomic< std::uint64_t >& value = local_counters().values[e];
+            value.store(value.load(std::memory_order::relaxed) + n, std::memory_order::relaxed); // only this thread writes
+        }
+    }
+
+    static snapshot take_snapshot() {
+        std::lock_guard< std::mutex > lock(registry_mutex);
+        snapshot                      res = exited;
+        for (thread_counters* c = live; c; c = c->next) {
+            for (unsigned e = 0; e < event_count; ++e) { res.values[e] += c->values[e].load(std::memory_order::relaxed); }
+        }
+        return res;
+    }
+};
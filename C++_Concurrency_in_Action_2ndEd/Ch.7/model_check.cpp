@@ -0,0 +1,508 @@
+#include "model_checker.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <vector>
+
+// Checks the memory orderings of lock_free_stack_7_6, lock_free_queue_7_13_SPSC and lock_free_queue_RC_tail_modified
+// with model_checker.h. Each container is restated below over model::atomic and model::var with the orderings of
+// its header, line for line, and run through small tests: keep both in sync when changing either.
+// Every container is also checked with one ordering weakened below what it needs, which the checker must reject: this
+// shows that the tests reach the executions the tuned orderings are there for.
+//     Ch7_model_check [budget = 3]
+// The budget bounds the preemptions plus stale loads of an execution.
+
+using std::memory_order;
+
+// lock_free_queue_7_13_SPSC, TailLoad is the ordering of the load of tail in pop_head()
+template < memory_order TailLoad >
+class queue_7_13_SPSC_model {
+    struct node {
+        model::var< int >   data;
+        model::var< node* > next;
+
+        node() : data(0), next(nullptr) {}
+    };
+
+    model::atomic< node* > head;
+    model::atomic< node* > tail;
+
+    node* pop_head() {
+        node* const old_head = head.load(memory_order::relaxed);
+        if (old_head == tail.load(TailLoad)) { return nullptr; }
+        head.store(old_head->next.read(), memory_order::relaxed);
+        return old_head;
+    }
+
+  public:
+    queue_7_13_SPSC_model() : head(model::make< node >()), tail(head.load()) {}
+
+    std::optional< int > pop() {
+        node* old_head = pop_head();
+        if (!old_head) { return std::nullopt; }
+
+        int const res = old_head->data.read();
+        model::destroy(old_head);
+        return res;
+    }
+    void push(int new_value) {
+        node*       p        = model::make< node >();
+        node* const old_tail = tail.load(memory_order::relaxed);
+        old_tail->data.write(new_value);
+        old_tail->next.write(p);
+        tail.store(p, memory_order::release);
+    }
+};
+
+// lock_free_stack< T, hazard_pointer_reclaimer > with hazardous_pointer_machinery over hazard_pointer_registry. A pop
+// claims a record and releases it when done, as a thread_local hp_owner does over the life of its thread, so records
+// get released and claimed again by another thread within a test. HazardStore is the ordering of the store that
+// publishes a hazard pointer in protect().
+template < memory_order HazardStore >
+class stack_7_6_model {
+    struct node {
+        model::var< int >   data;
+        model::var< node* > next;
+
+        explicit node(int data_) : data(data_), next(nullptr) {}
+    };
+    struct data_to_reclaim {
+        model::var< node* >            data;
+        model::var< data_to_reclaim* > next;
+
+        explicit data_to_reclaim(node* p) : data(p), next(nullptr) {}
+    };
+
+    // hazard_pointer_registry::record
+    struct hazard_record {
+        model::atomic< bool >        active;
+        model::atomic< void* >       pointer;
+        model::var< hazard_record* > next;
+
+        hazard_record() : active(true), pointer(nullptr), next(nullptr) {}
+    };
+
+    model::atomic< node* >            head { nullptr };
+    model::atomic< hazard_record* >   hazard_records { nullptr };
+    model::atomic< data_to_reclaim* > nodes_to_reclaim { nullptr };
+
+    // hazard_pointer_registry::acquire()
+    hazard_record* acquire_record() {
+        for (hazard_record* r = hazard_records.load(memory_order::acquire); r; r = r->next.read()) {
+            bool expected = false;
+            if (!r->active.load(memory_order::relaxed) && r->active.compare_exchange_strong(expected, true)) { return r; }
+        }
+        hazard_record* const r    = model::make< hazard_record >();
+        hazard_record*       next = hazard_records.load(memory_order::relaxed);
+        r->next.write(next);
+        while (!hazard_records.compare_exchange_weak(next, r)) { r->next.write(next); }
+        return r;
+    }
+    // hazard_pointer_registry::release()
+    void release_record(hazard_record* r) {
+        r->pointer.store(nullptr, memory_order::release);
+        r->active.store(false, memory_order::release);
+    }
+
+    void add_to_reclaim_list(data_to_reclaim* n) {
+        data_to_reclaim* next = nodes_to_reclaim.load(memory_order::relaxed);
+        n->next.write(next);
+        while (!nodes_to_reclaim.compare_exchange_weak(next, n, memory_order::release, memory_order::relaxed)) { n->next.write(next); }
+    }
+    // hazard_pointer_registry::contains()
+    bool outstanding_hazard_pointers_for(void* p) {
+        for (hazard_record* r = hazard_records.load(); r; r = r->next.read()) {
+            if (r->active.load() && r->pointer.load() == p) { return true; }
+        }
+        return false;
+    }
+    void delete_nodes_with_no_hazards() {
+        data_to_reclaim* current = nodes_to_reclaim.exchange(nullptr, memory_order::acquire);
+        while (current) {
+            data_to_reclaim* const next = current->next.read();
+            node* const            data = current->data.read();
+            if (!outstanding_hazard_pointers_for(data)) {
+                model::destroy(data);
+                model::destroy(current);
+            } else {
+                add_to_reclaim_list(current);
+            }
+            current = next;
+        }
+    }
+
+  public:
+    void push(int data) {
+        node* const new_node = model::make< node >(data);
+        node*       next     = head.load(memory_order::relaxed);
+        new_node->next.write(next);
+        while (!head.compare_exchange_weak(next, new_node, memory_order::release, memory_order::relaxed)) { new_node->next.write(next); }
+    }
+
+    std::optional< int > pop() {
+        hazard_record* const    record  = acquire_record();
+        model::atomic< void* >& hp      = record->pointer;
+        auto const              protect = [&](node* seen) {
+            node* temp;
+            do {
+                temp = seen;
+                hp.store(seen, HazardStore);
+                seen = head.load();
+            } while (seen != temp);
+            return seen;
+        };
+
+        node* old_head = protect(head.load());
+        while (old_head && !head.compare_exchange_weak(old_head, old_head->next.read())) { old_head = protect(old_head); }
+
+        std::optional< int > res;
+        if (old_head) {
+            res = old_head->data.read();
+            old_head->data.write(0);
+            hp.store(nullptr, memory_order::release); // guard::retire()
+            if (outstanding_hazard_pointers_for(old_head)) {
+                data_to_reclaim* const n = model::make< data_to_reclaim >(old_head);
+                add_to_reclaim_list(n);
+            } else {
+                model::destroy(old_head);
+            }
+            delete_nodes_with_no_hazards();
+        }
+        hp.store(nullptr, memory_order::release); // ~guard()
+        release_record(record);                   // ~hp_owner()
+        return res;
+    }
+};
+
+// The orderings of lock_free_queue_RC_tail_modified
+struct RC_tail_modified_orders {
+    inline static memory_order const release_ref             = memory_order::acq_rel;
+    inline static memory_order const increase_external_count = memory_order::acquire;
+    inline static memory_order const decrease_external_count = memory_order::release;
+    inline static memory_order const free_external_counter   = memory_order::acq_rel;
+    inline static memory_order const set_tail                = memory_order::release;
+    inline static memory_order const claim_data              = memory_order::release;
+    inline static memory_order const link_next               = memory_order::release;
+    inline static memory_order const read_next               = memory_order::relaxed;
+    inline static memory_order const read_tail               = memory_order::acquire;
+    inline static memory_order const set_head                = memory_order::relaxed;
+    inline static memory_order const read_data               = memory_order::acquire;
+};
+
+// The data of a pushed value published with a relaxed compare_exchange
+struct RC_tail_modified_relaxed_data : RC_tail_modified_orders {
+    inline static memory_order const claim_data = memory_order::relaxed;
+};
+
+// The reference counts dropped with acquire only, as in listing 7.20: the thread that frees a node does not
+// synchronize with the threads that dropped the other references
+struct RC_tail_modified_acquire_counts : RC_tail_modified_orders {
+    inline static memory_order const release_ref           = memory_order::acquire;
+    inline static memory_order const free_external_counter = memory_order::acquire;
+};
+
+// lock_free_queue_RC_tail_modified, with the counted pointer as a plain struct
+template < class Orders >
+class queue_RC_tail_modified_model {
+    struct node;
+
+    class counted_node_ptr {
+        int   count = 0;
+        node* p     = nullptr;
+
+      public:
+        counted_node_ptr() = default;
+        counted_node_ptr(int external_count, node* ptr_) : count(external_count), p(ptr_) {}
+
+        node* ptr() const { return p; }
+        int   external_count() const { return count; }
+        void  set_ptr(node* ptr_) { p = ptr_; }
+        void  set_external_count(int external_count) { count = external_count; }
+
+        bool operator==(counted_node_ptr const&) const = default;
+    };
+
+    struct node_counter {
+        unsigned internal_count : 30;
+        unsigned external_counters : 2;
+
+        bool operator==(node_counter const& other) const {
+            return internal_count == other.internal_count && external_counters == other.external_counters;
+        }
+    };
+    static node_counter initial_counter() {
+        node_counter new_count {};
+        new_count.internal_count    = 0;
+        new_count.external_counters = 2;
+        return new_count;
+    }
+
+    struct value {
+        model::var< int > data;
+
+        explicit value(int data_) : data(data_) {}
+    };
+
+    struct node {
+        model::atomic< value* >           data;
+        model::atomic< node_counter >     count;
+        model::atomic< counted_node_ptr > next;
+
+        node() : data(nullptr), count(initial_counter()), next(counted_node_ptr()) {}
+
+        void release_ref() {
+            node_counter old_counter = count.load(memory_order::relaxed);
+            node_counter new_counter;
+            for (;;) {
+                new_counter = old_counter;
+                --new_counter.internal_count;
+                if (count.compare_exchange_strong(old_counter, new_counter, Orders::release_ref, memory_order::relaxed)) { break; }
+            }
+            if (!new_counter.internal_count && !new_counter.external_counters) { model::destroy(this); }
+        }
+    };
+
+    model::atomic< counted_node_ptr > head;
+    model::atomic< counted_node_ptr > tail;
+
+    // pooled_node_allocator hands out nodes freed by the same thread, node() re-initializes them with relaxed stores
+    static node* make_node() {
+        node* const n = model::reuse< node >();
+        if (!n) { return model::make< node >(); }
+        n->data.store(nullptr, memory_order::relaxed);
+        n->count.store(initial_counter(), memory_order::relaxed);
+        n->next.store(counted_node_ptr(), memory_order::relaxed);
+        return n;
+    }
+
+    static void increase_external_count(model::atomic< counted_node_ptr >& counter, counted_node_ptr& old_counter) {
+        counted_node_ptr new_counter;
+        for (;;) {
+            new_counter = old_counter;
+            new_counter.set_external_count(old_counter.external_count() + 1);
+            if (counter.compare_exchange_strong(old_counter, new_counter, Orders::increase_external_count, memory_order::relaxed)) { break; }
+        }
+        old_counter = new_counter;
+    }
+
+    static void decrease_external_count(model::atomic< counted_node_ptr >& counter, counted_node_ptr& old_counter, node* ptr) {
+        while (old_counter.ptr() == ptr) {
+            counted_node_ptr new_counter = old_counter;
+            new_counter.set_external_count(old_counter.external_count() - 1);
+            if (counter.compare_exchange_weak(old_counter, new_counter, Orders::decrease_external_count, memory_order::relaxed)) {
+                old_counter = new_counter;
+                return;
+            }
+        }
+        ptr->release_ref();
+    }
+
+    static void free_external_counter(counted_node_ptr& old_node_ptr) {
+        node* const  ptr            = old_node_ptr.ptr();
+        int const    count_increase = old_node_ptr.external_count() - 2;
+        node_counter old_counter    = ptr->count.load(memory_order::relaxed);
+        node_counter new_counter;
+        for (;;) {
+            new_counter = old_counter;
+            --new_counter.external_counters;
+            new_counter.internal_count += count_increase;
+            if (ptr->count.compare_exchange_strong(old_counter, new_counter, Orders::free_external_counter, memory_order::relaxed)) { break; }
+        }
+        if (!new_counter.internal_count && !new_counter.external_counters) { model::destroy(ptr); }
+    }
+
+    void set_new_tail(counted_node_ptr& old_tail, counted_node_ptr const& new_tail) {
+        node* const current_tail_ptr = old_tail.ptr();
+        while (!tail.compare_exchange_weak(old_tail, new_tail, Orders::set_tail, memory_order::relaxed) && old_tail.ptr() == current_tail_ptr) {}
+        if (old_tail.ptr() == current_tail_ptr)
+            free_external_counter(old_tail);
+        else
+            current_tail_ptr->release_ref();
+    }
+
+  public:
+    queue_RC_tail_modified_model() : head(counted_node_ptr(1, make_node())), tail(head.load()) {}
+
+    void push(int new_value) {
+        value* const     new_data = model::make< value >(new_value);
+        counted_node_ptr new_next(1, make_node());
+        counted_node_ptr old_tail = tail.load(memory_order::relaxed);
+        for (;;) {
+            increase_external_count(tail, old_tail);
+            value* old_data = nullptr;
+            if (old_tail.ptr()->data.compare_exchange_strong(old_data, new_data, Orders::claim_data, memory_order::relaxed)) {
+                counted_node_ptr old_next;
+                if (!old_tail.ptr()->next.compare_exchange_strong(old_next, new_next, Orders::link_next, memory_order::acquire)) {
+                    model::destroy(new_next.ptr());
+                    new_next = old_next;
+                }
+                set_new_tail(old_tail, new_next);
+                break;
+            } else {
+                counted_node_ptr old_next;
+                if (old_tail.ptr()->next.compare_exchange_strong(old_next, new_next, Orders::link_next, memory_order::acquire)) {
+                    old_next = new_next;
+                    new_next.set_ptr(make_node());
+                }
+                set_new_tail(old_tail, old_next);
+            }
+        }
+    }
+
+    std::optional< int > pop() {
+        counted_node_ptr old_head = head.load(memory_order::relaxed);
+        for (;;) {
+            increase_external_count(head, old_head);
+            node* const ptr = old_head.ptr();
+            if (ptr == tail.load(Orders::read_tail).ptr()) {
+                decrease_external_count(head, old_head, ptr);
+                return std::nullopt;
+            }
+            counted_node_ptr next = ptr->next.load(Orders::read_next);
+            if (head.compare_exchange_strong(old_head, next, Orders::set_head, memory_order::relaxed)) {
+                value* const res = ptr->data.load(Orders::read_data);
+                free_external_counter(old_head);
+                int const data = res->data.read();
+                model::destroy(res);
+                return data;
+            }
+            decrease_external_count(head, old_head, ptr);
+        }
+    }
+};
+
+// Producer pushes 1 and 2, the consumer pops three times: what it got and what is left must be 1, 2 in order
+template < class Queue >
+struct spsc_handoff {
+    inline static unsigned const threads = 2;
+
+    Queue              queue;
+    std::vector< int > popped;
+
+    void run(unsigned index) {
+        if (index == 0) {
+            queue.push(1);
+            queue.push(2);
+        } else {
+            for (int i = 0; i < 3; ++i) {
+                if (std::optional< int > const value = queue.pop()) { popped.push_back(*value); }
+            }
+        }
+    }
+    void check() {
+        while (std::optional< int > const value = queue.pop()) { popped.push_back(*value); }
+        model::expect(popped == std::vector< int > { 1, 2 }, "values lost, duplicated or out of order");
+    }
+};
+
+// Two threads pop from a container holding 1 and 2 while one of them also pushes 3: every value comes out exactly once
+template < class Container >
+struct pop_pop_push {
+    inline static unsigned const threads = 2;
+
+    Container          container;
+    std::vector< int > popped[threads];
+
+    pop_pop_push() {
+        container.push(1);
+        container.push(2);
+    }
+    void run(unsigned index) {
+        if (index == 1) { container.push(3); }
+        if (std::optional< int > const value = container.pop()) { popped[index].push_back(*value); }
+    }
+    void check() {
+        std::vector< int > all = popped[0];
+        all.insert(all.end(), popped[1].begin(), popped[1].end());
+        while (std::optional< int > const value = container.pop()) { all.push_back(*value); }
+        std::sort(all.begin(), all.end());
+        model::expect(all == std::vector< int > { 1, 2, 3 }, "values lost or duplicated");
+    }
+};
+
+// One thread pushes 1 and 2, the other pushes 3 and pops twice: per producer, values come out in push order
+template < class Queue >
+struct mpmc_push_pop {
+    inline static unsigned const threads = 2;
+
+    Queue              queue;
+    std::vector< int > popped;
+
+    void run(unsigned index) {
+        if (index == 0) {
+            queue.push(1);
+            queue.push(2);
+        } else {
+            queue.push(3);
+            for (int i = 0; i < 2; ++i) {
+                if (std::optional< int > const value = queue.pop()) { popped.push_back(*value); }
+            }
+        }
+    }
+    void check() {
+        while (std::optional< int > const value = queue.pop()) { popped.push_back(*value); }
+        std::vector< int > sorted = popped;
+        std::sort(sorted.begin(), sorted.end());
+        model::expect(sorted == std::vector< int > { 1, 2, 3 }, "values lost or duplicated");
+        model::expect(std::find(popped.begin(), popped.end(), 1) < std::find(popped.begin(), popped.end(), 2), "values of one producer out of order");
+    }
+};
+
+// Two threads pop from a queue holding 1 and 2, then push 3 and 4: the nodes freed by the pops are pushed again
+template < class Queue >
+struct pop_then_push {
+    inline static unsigned const threads = 2;
+
+    Queue              queue;
+    std::vector< int > popped[threads];
+
+    pop_then_push() {
+        queue.push(1);
+        queue.push(2);
+    }
+    void run(unsigned index) {
+        if (std::optional< int > const value = queue.pop()) { popped[index].push_back(*value); }
+        queue.push(static_cast< int >(3 + index));
+    }
+    void check() {
+        std::vector< int > all = popped[0];
+        all.insert(all.end(), popped[1].begin(), popped[1].end());
+        while (std::optional< int > const value = queue.pop()) { all.push_back(*value); }
+        std::sort(all.begin(), all.end());
+        model::expect(all == std::vector< int > { 1, 2, 3, 4 }, "values lost or duplicated");
+    }
+};
+
+template < class Test >
+bool verify(char const* name, unsigned budget, bool must_pass) {
+    model::result const res = model::checker::explore< Test >(budget);
+    bool const          ok  = res.error.empty() == must_pass;
+    std::printf("%-72s executions=%-9zu %s\n", name, res.executions, res.error.empty() ? "passed" : "rejected");
+    if (!res.error.empty()) { std::printf("    %s\n    schedule: %s\n", res.error.c_str(), res.schedule.c_str()); }
+    if (!ok) { std::printf("    UNEXPECTED: this test must %s\n", must_pass ? "pass" : "be rejected"); }
+    return ok;
+}
+
+int main(int argc, char** argv) {
+    unsigned const budget = argc > 1 ? static_cast< unsigned >(std::strtoul(argv[1], nullptr, 10)) : 3;
+
+    bool ok = true;
+    ok &= verify< spsc_handoff< queue_7_13_SPSC_model< memory_order::acquire > > >("lock_free_queue_7_13_SPSC", budget, true);
+    ok &= verify< spsc_handoff< queue_7_13_SPSC_model< memory_order::relaxed > > >("lock_free_queue_7_13_SPSC, relaxed load of tail", budget, false);
+
+    ok &= verify< pop_pop_push< stack_7_6_model< memory_order::seq_cst > > >("lock_free_stack_7_6", budget, true);
+    ok &= verify< pop_pop_push< stack_7_6_model< memory_order::release > > >("lock_free_stack_7_6, release store of the hazard pointer",
+                                                                               budget, false);
+
+    ok &= verify< mpmc_push_pop< queue_RC_tail_modified_model< RC_tail_modified_orders > > >("lock_free_queue_RC_tail_modified", budget, true);
+    ok &= verify< pop_pop_push< queue_RC_tail_modified_model< RC_tail_modified_orders > > >("lock_free_queue_RC_tail_modified, two poppers",
+                                                                                           budget, true);
+    ok &= verify< pop_then_push< queue_RC_tail_modified_model< RC_tail_modified_orders > > >("lock_free_queue_RC_tail_modified, recycled nodes",
+                                                                                            budget, true);
+    ok &= verify< mpmc_push_pop< queue_RC_tail_modified_model< RC_tail_modified_relaxed_data > > >(
+        "lock_free_queue_RC_tail_modified, relaxed claim of the data", budget, false);
+    ok &= verify< mpmc_push_pop< queue_RC_tail_modified_model< RC_tail_modified_acquire_counts > > >(
+        "lock_free_queue_RC_tail_modified, acquire-only reference counts", budget, false);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
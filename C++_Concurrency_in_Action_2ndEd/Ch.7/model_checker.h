@@ -0,0 +1,540 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+// Stateless model checker for small tests of the containers of this chapter, in the spirit of Relacy and CDSChecker.
+// A test runs a few threads over model::atomic and model::var instead of std::atomic and plain members. The checker
+// lets one thread run at a time and replays the test once per schedule until it has explored:
+// - every interleaving of the atomic operations with at most `budget` preemptions,
+// - for every load, each store the C++ memory model lets it read: release/acquire synchronization, coherence and one
+//   total order of the seq_cst operations are tracked with vector clocks. Reading an older store than the latest one
+//   costs one unit of budget as well.
+// Plain variables are checked for data races, nodes freed with model::destroy() for accesses that race with the free
+// or come after it, and the test itself for failed model::expect(). A failure prints the schedule that led to it.
+// model::reuse() hands a destroyed node back to the thread that destroyed it, as a free list of a pooled allocator
+// does: its atomics keep their history, so stores that re-initialize it are checked like any other.
+// Limits: the modification order of an atomic follows the order its stores ran in, compare_exchange reads the latest
+// value and never fails spuriously, fences are not modelled (the containers checked here do not use any).
+// see more about the technique: Dmitry Vyukov, Relacy race detector, 2008
+//                               Brian Norris and Brian Demsky, CDSChecker: checking concurrent data structures written
+//                               with C/C++ atomics, 2013
+//                               Madanlal Musuvathi and Shaz Qadeer, Iterative context bounding for systematic testing
+//                               of multithreaded programs, 2007
+namespace model {
+
+inline constexpr unsigned max_threads = 4;
+inline constexpr unsigned setup       = max_threads; // index of the thread running the constructor and check() of a test
+
+using clock = std::array< std::uint32_t, max_threads + 1 >;
+
+inline void join(clock& into, clock const& from) {
+    for (unsigned i = 0; i <= max_threads; ++i) { into[i] = std::max(into[i], from[i]); }
+}
+inline bool is_acquire(std::memory_order order) { return order != std::memory_order::relaxed && order != std::memory_order::release; }
+inline bool is_release(std::memory_order order) {
+    return order == std::memory_order::release || order == std::memory_order::acq_rel || order == std::memory_order::seq_cst;
+}
+inline std::memory_order failure_order(std::memory_order success) {
+    if (success == std::memory_order::acq_rel) { return std::memory_order::acquire; }
+    if (success == std::memory_order::release) { return std::memory_order::relaxed; }
+    return success;
+}
+
+struct execution_aborted {};
+
+class tracked;
+
+// A node made by model::make(), its members are checked when it is destroyed
+struct allocation {
+    std::vector< tracked* > members;
+    bool                    freed  = false;
+    void*                   object = nullptr;
+    std::type_info const*   type   = nullptr;
+};
+
+struct result {
+    std::size_t executions = 0;
+    std::string error; // empty if every execution passed
+    std::string schedule;
+};
+
+class checker {
+    struct choice {
+        unsigned taken;
+        unsigned count;
+    };
+
+    inline static std::mutex                                          mutex;
+    inline static std::condition_variable                             wakeup;
+    inline static unsigned                                            running;
+    inline static bool                                                aborted;
+    inline static std::array< bool, max_threads >                     finished;
+    inline static unsigned                                            thread_count;
+    inline static bool                                                exploring = false;
+    inline static unsigned                                            budget;
+    inline static unsigned                                            spent;
+    inline static std::size_t                                         steps;
+    inline static std::vector< choice >                               trace;
+    inline static std::size_t                                         position;
+    inline static std::string                                         error;
+    inline static std::vector< std::pair< std::unique_ptr< allocation >, std::function< void() > > > arena;
+    inline static std::map< void const*, allocation* >                allocations;
+    inline static std::array< std::vector< allocation* >, max_threads + 1 > free_lists; // destroyed nodes, per thread
+
+    // Replays trace, then extends it with first choices. Choices below free cost nothing, the others one unit of
+    // budget each; once the budget is spent only the free ones are left.
+    static unsigned choose(unsigned count, unsigned free) {
+        if (spent >= budget) { count = std::min(count, free); }
+        if (position == trace.size()) { trace.push_back({ 0, count }); }
+        unsigned const taken = trace[position++].taken;
+        if (taken >= free) { ++spent; }
+        return taken;
+    }
+
+    // Next schedule in depth-first order, false when all have been explored
+    static bool backtrack() {
+        while (!trace.empty() && trace.back().taken + 1 >= trace.back().count) { trace.pop_back(); }
+        if (trace.empty()) { return false; }
+        ++trace.back().taken;
+        return true;
+    }
+
+    static void wait_turn(std::unique_lock< std::mutex >& lock) {
+        wakeup.wait(lock, [] { return running == self || aborted; });
+        if (aborted) { throw execution_aborted {}; }
+    }
+
+    static void thread_main(unsigned index, std::function< void(unsigned) > const& body) {
+        self = index;
+        try {
+            {
+                std::unique_lock< std::mutex > lock(mutex);
+                wait_turn(lock);
+            }
+            body(index);
+        } catch (execution_aborted const&) {}
+        std::lock_guard< std::mutex > lock(mutex);
+        finished[index] = true;
+        if (aborted) { return; }
+        unsigned runnable[max_threads];
+        unsigned n = 0;
+        for (unsigned t = 0; t < thread_count; ++t) {
+            if (!finished[t]) { runnable[n++] = t; }
+        }
+        if (n) {
+            running = runnable[choose(n, n)]; // not a preemption, every choice is free
+            wakeup.notify_all();
+        }
+    }
+
+    static std::string describe_schedule() {
+        std::string res;
+        for (choice const& c : trace) { res += std::to_string(c.taken) + "/" + std::to_string(c.count) + " "; }
+        return res;
+    }
+
+  public:
+    inline static thread_local unsigned           self = setup;
+    inline static std::array< clock, max_threads + 1 > clocks;
+    inline static allocation*                     constructing = nullptr;
+
+    // Called before every atomic operation: may hand over to another thread
+    static void point() {
+        if (!exploring) { return; }
+        std::unique_lock< std::mutex > lock(mutex);
+        if (aborted) { throw execution_aborted {}; }
+        if (++steps > max_steps) {
+            lock.unlock();
+            fail("more than " + std::to_string(max_steps) + " steps, livelock or unbounded retry loop");
+        }
+        unsigned candidates[max_threads];
+        unsigned n      = 0;
+        candidates[n++] = self;
+        for (unsigned t = 0; t < thread_count; ++t) {
+            if (t != self && !finished[t]) { candidates[n++] = t; }
+        }
+        unsigned const next = candidates[choose(n, 1)];
+        if (next == self) { return; }
+        running = next;
+        wakeup.notify_all();
+        wait_turn(lock);
+    }
+
+    // Picks the store a load reads among the last count ones, 0 being the latest
+    static std::size_t choose_store(std::size_t count) { return exploring ? choose(static_cast< unsigned >(count), 1) : 0; }
+
+    [[noreturn]] static void fail(std::string const& message) {
+        {
+            std::lock_guard< std::mutex > lock(mutex);
+            if (error.empty()) { error = "thread " + std::to_string(self) + ": " + message; }
+            aborted = true;
+            wakeup.notify_all();
+        }
+        throw execution_aborted {};
+    }
+
+    static bool happens_before(unsigned thread, std::uint32_t epoch) { return clocks[self][thread] >= epoch; }
+    static std::uint32_t epoch() { return clocks[self][self]; }
+    static void          tick() { ++clocks[self][self]; }
+
+    static void remember(void const* p, std::unique_ptr< allocation > a, std::function< void() > deleter) {
+        allocations[p] = a.get();
+        arena.emplace_back(std::move(a), std::move(deleter));
+    }
+    static allocation* find(void const* p) {
+        auto const it = allocations.find(p);
+        return it == allocations.end() ? nullptr : it->second;
+    }
+    static void recycle(allocation* a) { free_lists[self].push_back(a); }
+    // Latest node of type destroyed by the calling thread and not reused yet, nullptr if there is none
+    static void* reuse(std::type_info const& type) {
+        std::vector< allocation* >& list = free_lists[self];
+        for (std::size_t i = list.size(); i-- > 0;) {
+            allocation* const a = list[i];
+            if (*a->type == type) {
+                list.erase(list.begin() + static_cast< std::ptrdiff_t >(i));
+                a->freed = false;
+                return a->object;
+            }
+        }
+        return nullptr;
+    }
+
+    inline static std::size_t max_steps = 10'000;
+
+    // Runs Test over every schedule within budget. Test() sets up the shared state on the setup thread, run(index)
+    // is the body of thread index, check() runs once all threads have finished and sees everything they did.
+    template < class Test >
+    static result explore(unsigned budget_) {
+        result res;
+        budget = budget_;
+        trace.clear();
+        do {
+            ++res.executions;
+            run_once< Test >();
+            if (!error.empty()) {
+                res.error    = error;
+                res.schedule = describe_schedule();
+                break;
+            }
+        } while (backtrack());
+        return res;
+    }
+
+  private:
+    template < class Test >
+    static void run_once() {
+        position = 0;
+        spent    = 0;
+        steps    = 0;
+        aborted  = false;
+        error.clear();
+        finished.fill(false);
+        for (clock& c : clocks) { c.fill(0); }
+        for (unsigned t = 0; t <= max_threads; ++t) { clocks[t][t] = 1; }
+        self = setup;
+
+        {
+            std::unique_ptr< Test > test;
+            try {
+                test = std::make_unique< Test >();
+            } catch (execution_aborted const&) {}
+
+            if (test) {
+                thread_count = Test::threads;
+                for (unsigned t = 0; t < thread_count; ++t) { join(clocks[t], clocks[setup]); } // std::thread constructor
+                tick();
+                running   = choose(thread_count, thread_count);
+                exploring = true;
+                std::function< void(unsigned) > const body = [&](unsigned index) { test->run(index); };
+                std::vector< std::thread >            threads;
+                for (unsigned t = 0; t < thread_count; ++t) { threads.emplace_back(thread_main, t, std::cref(body)); }
+                for (std::thread& t : threads) { t.join(); }
+                exploring = false;
+
+                if (error.empty()) {
+                    for (unsigned t = 0; t < thread_count; ++t) { join(clocks[setup], clocks[t]); } // std::thread::join
+                    try {
+                        test->check();
+                    } catch (execution_aborted const&) {}
+                }
+            }
+        }
+        for (auto& a : arena) { a.second(); }
+        arena.clear();
+        allocations.clear();
+        for (std::vector< allocation* >& list : free_lists) { list.clear(); }
+    }
+};
+
+inline void expect(bool condition, char const* message) {
+    if (!condition) { checker::fail(std::string("check failed: ") + message); }
+}
+
+// Member of a node: registers with the node being made so that its accesses are checked against destroy()
+class tracked {
+    allocation* const owner;
+
+  protected:
+    tracked() : owner(checker::constructing) {
+        if (owner) { owner->members.push_back(this); }
+    }
+    virtual ~tracked() = default;
+
+    void check_alive() const {
+        // a member of a node reached through a null pointer; undefined, but reported instead of crashing the checker
+        if (reinterpret_cast< std::uintptr_t >(this) < 4096) { checker::fail("null pointer dereference"); }
+        if (owner && owner->freed) { checker::fail("access to a destroyed node"); }
+    }
+
+  public:
+    tracked(tracked const&) = delete;
+    tracked operator=(tracked const&) = delete;
+
+    // Every earlier access must happen before the free
+    virtual void check_free() const = 0;
+};
+
+// Stands for std::atomic< T >; T needs operator== for compare_exchange
+template < class T >
+class atomic : public tracked {
+    struct store_record {
+        T             value;
+        unsigned      thread;
+        std::uint32_t epoch;
+        clock         sync;     // what an acquire load reading this store synchronizes with
+        bool          releases; // false outside release sequences
+    };
+
+    std::vector< store_record >                   history;          // modification order
+    std::array< std::size_t, max_threads + 1 >    observed {};      // latest store each thread read or wrote
+    std::size_t                                   last_seq_cst = 0; // latest seq_cst store
+    std::array< std::uint32_t, max_threads + 1 > accessed {};
+
+    // Initializing an atomic is not an atomic operation, it must happen before every access
+    void check_constructed() const {
+        if (!checker::happens_before(history.front().thread, history.front().epoch)) {
+            checker::fail("access to an atomic racing with its construction");
+        }
+    }
+
+    void accessed_now(std::size_t index) {
+        observed[checker::self] = index;
+        accessed[checker::self] = checker::epoch();
+        checker::tick();
+    }
+
+    void append(T const& value, std::memory_order order, clock sync, bool releases) {
+        if (is_release(order)) {
+            join(sync, checker::clocks[checker::self]);
+            releases = true;
+        }
+        history.push_back({ value, checker::self, checker::epoch(), sync, releases });
+        if (order == std::memory_order::seq_cst) { last_seq_cst = history.size() - 1; }
+        accessed_now(history.size() - 1);
+    }
+
+    void acquire_from(std::size_t index, std::memory_order order) {
+        if (is_acquire(order) && history[index].releases) { join(checker::clocks[checker::self], history[index].sync); }
+    }
+
+    // Reads the latest value, then stores update(value) unless it returns false; returns the value read
+    template < class Update >
+    std::pair< T, bool > read_modify_write(Update update, std::memory_order success, std::memory_order failure) {
+        checker::point();
+        check_alive();
+        check_constructed();
+        std::size_t const index = history.size() - 1;
+        T                 value = history[index].value;
+        T const           old   = value;
+        if (!update(value)) {
+            acquire_from(index, failure);
+            accessed_now(index);
+            return { old, false };
+        }
+        acquire_from(index, success);
+        append(value, success, history[index].sync, history[index].releases); // continues a release sequence
+        return { old, true };
+    }
+
+  public:
+    explicit atomic(T initial = T()) : history { { initial, checker::self, checker::epoch(), {}, false } } {
+        accessed[checker::self] = checker::epoch();
+    }
+
+    T load(std::memory_order order = std::memory_order::seq_cst) {
+        checker::point();
+        check_alive();
+        check_constructed();
+        clock const& own = checker::clocks[checker::self];
+        std::size_t  lo  = observed[checker::self];
+        for (std::size_t i = history.size(); i-- > lo;) {
+            if (own[history[i].thread] >= history[i].epoch) { // a later store hides the ones before it
+                lo = i;
+                break;
+            }
+        }
+        if (order == std::memory_order::seq_cst) { lo = std::max(lo, last_seq_cst); }
+        std::size_t const index = history.size() - 1 - checker::choose_store(history.size() - lo);
+        acquire_from(index, order);
+        accessed_now(index);
+        return history[index].value;
+    }
+
+    void store(T const& value, std::memory_order order = std::memory_order::seq_cst) {
+        checker::point();
+        check_alive();
+        check_constructed();
+        append(value, order, {}, false);
+    }
+
+    T exchange(T const& value, std::memory_order order = std::memory_order::seq_cst) {
+        return read_modify_write(
+                   [&](T& v) {
+                       v = value;
+                       return true;
+                   },
+                   order, order)
+            .first;
+    }
+
+    bool compare_exchange_strong(T& expected, T const& desired, std::memory_order success, std::memory_order failure) {
+        auto const [old, exchanged] = read_modify_write(
+            [&](T& v) {
+                if (!(v == expected)) { return false; }
+                v = desired;
+                return true;
+            },
+            success, failure);
+        if (!exchanged) { expected = old; }
+        return exchanged;
+    }
+    bool compare_exchange_strong(T& expected, T const& desired, std::memory_order order = std::memory_order::seq_cst) {
+        return compare_exchange_strong(expected, desired, order, failure_order(order));
+    }
+    bool compare_exchange_weak(T& expected, T const& desired, std::memory_order success, std::memory_order failure) {
+        return compare_exchange_strong(expected, desired, success, failure);
+    }
+    bool compare_exchange_weak(T& expected, T const& desired, std::memory_order order = std::memory_order::seq_cst) {
+        return compare_exchange_strong(expected, desired, order, failure_order(order));
+    }
+
+    T fetch_add(T const& arg, std::memory_order order = std::memory_order::seq_cst) {
+        return read_modify_write(
+                   [&](T& v) {
+                       v += arg;
+                       return true;
+                   },
+                   order, order)
+            .first;
+    }
+    T fetch_sub(T const& arg, std::memory_order order = std::memory_order::seq_cst) {
+        return read_modify_write(
+                   [&](T& v) {
+                       v -= arg;
+                       return true;
+                   },
+                   order, order)
+            .first;
+    }
+
+    void check_free() const override {
+        for (unsigned t = 0; t <= max_threads; ++t) {
+            if (accessed[t] && !checker::happens_before(t, accessed[t])) {
+                checker::fail("node destroyed while thread " + std::to_string(t) + " may still access one of its atomics");
+            }
+        }
+    }
+};
+
+// Stands for a plain variable: any two accesses, one of them a write, must be ordered by happens-before
+template < class T >
+class var : public tracked {
+    T                                             value;
+    unsigned                                      writer;
+    std::uint32_t                                 write_epoch;
+    std::array< std::uint32_t, max_threads + 1 > reads {};
+
+    void check_writes() const {
+        if (!checker::happens_before(writer, write_epoch)) { checker::fail("data race with a write of thread " + std::to_string(writer)); }
+    }
+    void check_reads() const {
+        for (unsigned t = 0; t <= max_threads; ++t) {
+            if (reads[t] && !checker::happens_before(t, reads[t])) { checker::fail("data race with a read of thread " + std::to_string(t)); }
+        }
+    }
+
+  public:
+    explicit var(T initial = T()) : value(std::move(initial)), writer(checker::self), write_epoch(checker::epoch()) {}
+
+    T read() {
+        check_alive();
+        check_writes();
+        reads[checker::self] = checker::epoch();
+        return value;
+    }
+    void write(T v) {
+        check_alive();
+        check_writes();
+        check_reads();
+        reads.fill(0);
+        writer      = checker::self;
+        write_epoch = checker::epoch();
+        value       = std::move(v);
+    }
+
+    void check_free() const override {
+        check_writes();
+        check_reads();
+    }
+};
+
+// Stands for Allocator::create< T >(args...); the memory is kept until the end of the execution
+template < class T, class... Args >
+T* make(Args&&... args) {
+    auto               a     = std::make_unique< allocation >();
+    allocation* const  outer = checker::constructing;
+    checker::constructing    = a.get();
+    T* const p               = new T(std::forward< Args >(args)...);
+    checker::constructing    = outer;
+    a->object                = p;
+    a->type                  = &typeid(T);
+    checker::remember(p, std::move(a), [p] { delete p; });
+    return p;
+}
+
+// Stands for Allocator::destroy(p)
+template < class T >
+void destroy(T* p) {
+    allocation* const a = checker::find(p);
+    if (!a) { checker::fail("destroy() of a pointer not made by model::make()"); }
+    if (a->freed) { checker::fail("node destroyed twice"); }
+    for (tracked const* m : a->members) { m->check_free(); }
+    a->freed = true;
+    checker::recycle(a);
+}
+
+// Stands for Allocator::allocate() served from the free list of the calling thread, as pooled_node_allocator does:
+// returns a node of type T destroyed by this thread, or nullptr. The node is not constructed again, the caller
+// re-initializes it with the stores the constructor of the real node makes. Accesses through pointers kept from
+// before the free are no longer reported once the node is reused.
+template < class T >
+T* reuse() {
+    return static_cast< T* >(checker::reuse(typeid(T)));
+}
+
+} // namespace model
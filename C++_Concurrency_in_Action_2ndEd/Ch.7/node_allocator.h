@@ -0,0 +1,170 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <mutex>
+#include <new>
+#include <utility>
+
+// Node allocator policies for the lock-free containers.
+// An allocator policy provides
+//     template < class Node, class... Args > static Node* create(Args&&...);
+//     template < class Node > static void destroy(Node*) noexcept;
+// Every node of a container, including the ones released by its reclamation scheme, goes through the policy.
+
+// Global operator new/delete for every node
+struct new_delete_node_allocator {
+    template < class Node, class... Args >
+    static Node* create(Args&&... args) {
+        return new Node(std::forward< Args >(args)...);
+    }
+    template < class Node >
+    static void destroy(Node* node) noexcept {
+        delete node;
+    }
+};
+
+// Pool of fixed-size blocks shared by every node type with the same size and alignment.
+// Each thread allocates from and frees into its own free list, without any synchronization. When a thread's list
+// grows past 2 * batch_size, one batch moves to a global overflow list, where threads with an empty list pick it up.
+// The overflow list is a stack of whole batches behind a mutex: it is touched once per batch_size allocations or frees.
+// Blocks are only returned to the system when the program exits.
+template < std::size_t Size, std::size_t Align >
+class node_pool {
+  private:
+    struct free_block {
+        free_block* next;        // next free block of the same list
+        free_block* next_batch;  // first block of the following batch, while on the overflow list
+        std::size_t batch_count; // number of blocks in this batch, while on the overflow list
+    };
+
+    inline static std::size_t const batch_size  = 64;
+    inline static std::size_t const block_size  = std::max(Size, sizeof(free_block));
+    inline static std::size_t const block_align = std::max(Align, alignof(free_block));
+
+    static void* allocate_block() { return ::operator new(block_size, std::align_val_t(block_align)); }
+    static void  free_chain(free_block* blocks) {
+        while (blocks) {
+            free_block* const next = blocks->next;
+            ::operator delete(blocks, std::align_val_t(block_align));
+            blocks = next;
+        }
+    }
+
+    class overflow_list {
+        std::mutex  mutex;
+        free_block* head = nullptr;
+
+      public:
+        overflow_list() = default;
+        ~overflow_list() {
+            while (head) {
+                free_block* const next_batch = head->next_batch;
+                free_chain(head);
+                head = next_batch;
+            }
+        }
+
+        void push(free_block* batch, std::size_t count) {
+            batch->batch_count = count;
+            std::lock_guard< std::mutex > lock(mutex);
+            batch->next_batch = head;
+            head              = batch;
+        }
+
+        // Returns the first block of a batch and its size, the batch is the caller's once the lock is released
+        std::pair< free_block*, std::size_t > pop() {
+            std::lock_guard< std::mutex > lock(mutex);
+            free_block* const             batch = head;
+            if (!batch) { return { nullptr, 0 }; }
+            head = batch->next_batch;
+            return { batch, batch->batch_count };
+        }
+    };
+
+    static overflow_list& overflow() {
+        static overflow_list list;
+        return list;
+    }
+
+    // Trivially destructible, so it stays usable while other thread_local destructors free nodes (a reclamation
+    // domain freeing its retire list on thread exit for instance): once flushed, allocations come from the system and
+    // frees go to the overflow list as batches of one block
+    struct thread_cache {
+        free_block* blocks;
+        std::size_t count;
+        bool        flushed;
+    };
+
+    struct cache_flusher {
+        thread_cache& cache;
+
+        // Thread-local objects are destroyed before static ones, so the overflow list outlives every cache
+        ~cache_flusher() {
+            if (cache.blocks) { overflow().push(cache.blocks, cache.count); }
+            cache = { nullptr, 0, true };
+        }
+    };
+
+    static thread_cache& local_cache() {
+        thread_local thread_cache  cache { nullptr, 0, false };
+        thread_local cache_flusher flusher { cache };
+        return cache;
+    }
+
+  public:
+    static void* allocate() {
+        thread_cache& cache = local_cache();
+        if (cache.flushed) { return allocate_block(); }
+        if (!cache.blocks) {
+            auto const [batch, count] = overflow().pop();
+            if (!batch) { return allocate_block(); }
+            cache.blocks = batch;
+            cache.count  = count;
+        }
+        free_block* const block = cache.blocks;
+        cache.blocks            = block->next;
+        --cache.count;
+        return block;
+    }
+
+    static void deallocate(void* p) noexcept {
+        thread_cache& cache = local_cache();
+        if (cache.flushed) {
+            overflow().push(::new (p) free_block { nullptr, nullptr, 0 }, 1);
+            return;
+        }
+        free_block* const block = ::new (p) free_block { cache.blocks, nullptr, 0 };
+        cache.blocks            = block;
+        if (++cache.count < 2 * batch_size) { return; }
+
+        free_block* last = block;
+        for (std::size_t i = 1; i < batch_size; ++i) { last = last->next; }
+        cache.blocks = last->next;
+        cache.count -= batch_size;
+        last->next = nullptr;
+        overflow().push(block, batch_size);
+    }
+};
+
+// Default node allocator: per-thread free lists with a global overflow list, see node_pool
+struct pooled_node_allocator {
+    template < class Node, class... Args >
+    static Node* create(Args&&... args) {
+        using pool    = node_pool< sizeof(Node), alignof(Node) >;
+        void* const p = pool::allocate();
+        try {
+            return ::new (p) Node(std::forward< Args >(args)...);
+        } catch (...) {
+            pool::deallocate(p);
+            throw;
+        }
+    }
+    template < class Node >
+    static void destroy(Node* node) noexcept {
+        node->~Node();
+        node_pool< sizeof(Node), alignof(Node) >::deallocate(node);
+    }
+};
+
+using default_node_allocator = pooled_node_allocator;
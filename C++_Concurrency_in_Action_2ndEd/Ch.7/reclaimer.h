@@ -0,0 +1,318 @@
+#pragma once
+
+#include "counted_node_ptr.h"
+#include "epoch_domain.h"
+#include "hazard_pointer_domain.h"
+#include "hazard_pointer_registry.h"
+#include "lockfree_stats.h"
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <type_traits>
+
+// Memory reclamation policies for lock_free_stack and lock_free_queue_MS. A policy R provides
+//     template < class Node, class Allocator > class R::domain;  one per container, holds the per-container state
+//     domain::guard(domain&);                                   scope of one operation on the container
+//     template < unsigned Index = 0 > U* guard::protect(std::atomic< U* > const& src, U* seen);
+//         makes seen, just loaded from src, safe to dereference and returns the value of src it settled on
+//     void guard::retire(Node*);                                node unlinked by this operation, ends its protections
+//                                                               may be called once per node for several nodes
+//     R::protect_slots                                          how many Index values a guard supports
+//     R::keeps_retired_links                                    false if retire() may overwrite node->next
+// Policies without state are empty classes, containers hold their domain as [[no_unique_address]].
+
+// Listing 7.2: nodes are never freed
+struct leaking_reclaimer {
+    inline static unsigned const protect_slots       = 2;
+    inline static bool const     keeps_retired_links = true;
+
+    template < class Node, class Allocator >
+    class domain {
+      public:
+        class guard {
+          public:
+            explicit guard(domain&) {}
+
+            template < unsigned Index = 0, class U >
+            U* protect(std::atomic< U* > const&, U* seen) {
+                return seen;
+            }
+            void retire(Node*) {}
+        };
+    };
+};
+
+// Listing 7.5 The reference-counted reclamation machinery
+template < class Node, class Allocator >
+class ref_count_delete_machinery {
+  public:
+    std::atomic< Node* >    to_delete;
+    std::atomic< unsigned > threads_in_pop;
+
+    ref_count_delete_machinery() : to_delete(nullptr), threads_in_pop(0) {}
+    ~ref_count_delete_machinery() { delete_nodes(to_delete.load()); }
+
+    static void delete_nodes(Node* nodes) {
+        while (nodes) {
+            Node* next = nodes->next;
+            Allocator::destroy(nodes);
+            lockfree_stats::add(lockfree_stats::pending_freed);
+            nodes = next;
+        }
+    }
+
+    void try_reclaim(Node* old_head) {
+        if (threads_in_pop == 1) {
+            Node* nodes_to_delete = to_delete.exchange(nullptr);
+            if (!--threads_in_pop) {
+                delete_nodes(nodes_to_delete);
+            } else if (nodes_to_delete) {
+                chain_pending_nodes(nodes_to_delete);
+            }
+            if (old_head) { Allocator::destroy(old_head); }
+        } else {
+            if (old_head) { chain_pending_node(old_head); } // nothing to chain when pop() found the stack empty
+            --threads_in_pop;
+        }
+    }
+    void chain_pending_nodes(Node* nodes) {
+        Node* last = nodes;
+        while (Node* const next = last->next) { last = next; }
+        chain_pending_nodes(nodes, last);
+    }
+    void chain_pending_nodes(Node* first, Node* last) {
+        last->next = to_delete;
+        while (!to_delete.compare_exchange_weak(last->next, first))
+            ;
+    }
+    void chain_pending_node(Node* n) {
+        lockfree_stats::add(lockfree_stats::pending_chained);
+        chain_pending_nodes(n, n);
+    }
+};
+
+// Listing 7.4 Reclaiming nodes when no threads are in pop()
+// Pending nodes are chained through node->next, so the container must not need the link of an unlinked node
+struct threads_in_pop_reclaimer {
+    inline static unsigned const protect_slots       = 2;
+    inline static bool const     keeps_retired_links = false;
+
+    template < class Node, class Allocator >
+    class domain : public ref_count_delete_machinery< Node, Allocator > {
+      public:
+        class guard {
+            domain& machinery;
+            Node*   retired;
+
+          public:
+            explicit guard(domain& d) : machinery(d), retired(nullptr) { ++machinery.threads_in_pop; }
+            ~guard() { machinery.try_reclaim(retired); }
+
+            guard(guard const&) = delete;
+            guard operator=(guard const&) = delete;
+
+            template < unsigned Index = 0, class U >
+            U* protect(std::atomic< U* > const&, U* seen) {
+                return seen;
+            }
+            void retire(Node* n) {
+                if (retired) { machinery.chain_pending_node(retired); } // still counted in threads_in_pop: not freed yet
+                retired = n;
+            }
+        };
+    };
+};
+
+// Listing 7.7 A simple implementation of get_hazard_pointer_for_current_thread(), on a growable registry instead of
+// the book's fixed array of 100 hazard pointers
+// This technique is patented by IBM, and can only be used under GPL or with a licensing arrangement
+template < class Node, class Allocator >
+class hazardous_pointer_machinery {
+  private:
+    inline static hazard_pointer_registry hazard_pointers;
+
+    class hp_owner {
+        hazard_pointer_registry::record* hp;
+
+      public:
+        hp_owner(hp_owner const&) = delete;
+        hp_owner operator=(hp_owner const&) = delete;
+
+        hp_owner() : hp(hazard_pointers.acquire()) { lockfree_stats::add(lockfree_stats::hp_owner_claimed); }
+
+        ~hp_owner() {
+            hazard_pointers.release(hp);
+            lockfree_stats::add(lockfree_stats::hp_owner_released);
+        }
+
+        std::atomic< void* >& get_pointer() { return hp->pointer; }
+    };
+
+    template < class U >
+    static void do_delete(void* p) {
+        Allocator::destroy(static_cast< U* >(p));
+    }
+    struct data_to_reclaim {
+        void*                        data;
+        std::function< void(void*) > deleter;
+        data_to_reclaim*             next;
+
+        template < class U >
+        data_to_reclaim(U* p) : data(p), deleter(&do_delete< U >), next(nullptr) {}
+
+        ~data_to_reclaim() { deleter(data); }
+    };
+    std::atomic< data_to_reclaim* > nodes_to_reclaim;
+    void                            add_to_reclaim_list(data_to_reclaim* node) {
+        node->next = nodes_to_reclaim.load(std::memory_order::relaxed);
+        while (!nodes_to_reclaim.compare_exchange_weak(node->next, node, std::memory_order::release, std::memory_order::relaxed))
+            ;
+    }
+
+  public:
+    hazardous_pointer_machinery() : nodes_to_reclaim(nullptr) {}
+    ~hazardous_pointer_machinery() {
+        data_to_reclaim* current = nodes_to_reclaim.load();
+        while (current) {
+            data_to_reclaim* const next = current->next;
+            Allocator::destroy(current);
+            lockfree_stats::add(lockfree_stats::reclaim_freed);
+            current = next;
+        }
+    }
+
+    std::atomic< void* >& get_hazard_pointer_for_current_thread() {
+        thread_local static hp_owner hazard {};
+        return hazard.get_pointer();
+    }
+    bool outstanding_hazard_pointers_for(void* p) {
+        lockfree_stats::add(lockfree_stats::hazard_scans);
+        return hazard_pointers.contains(p);
+    }
+    template < class U >
+    void reclaim_later(U* data) {
+        add_to_reclaim_list(Allocator::template create< data_to_reclaim >(data));
+        lockfree_stats::add(lockfree_stats::reclaim_deferred);
+    }
+    void delete_nodes_with_no_hazards() {
+        data_to_reclaim* current = nodes_to_reclaim.exchange(nullptr, std::memory_order::acquire);
+        while (current) {
+            data_to_reclaim* const next = current->next;
+            if (!outstanding_hazard_pointers_for(current->data)) {
+                Allocator::destroy(current);
+                lockfree_stats::add(lockfree_stats::reclaim_freed);
+            } else {
+                add_to_reclaim_list(current);
+            }
+            current = next;
+        }
+    }
+};
+
+// Listing 7.6 An implementation of pop() using hazard pointers: one hazard pointer per thread, every retire()
+// checks all of them and then walks the whole reclaim list
+struct hazard_pointer_reclaimer {
+    inline static unsigned const protect_slots       = 1;
+    inline static bool const     keeps_retired_links = true;
+
+    template < class Node, class Allocator >
+    class domain : public hazardous_pointer_machinery< Node, Allocator > {
+      public:
+        class guard {
+            domain&               machinery;
+            std::atomic< void* >& hp;
+
+          public:
+            explicit guard(domain& d) : machinery(d), hp(d.get_hazard_pointer_for_current_thread()) {}
+            ~guard() { hp.store(nullptr, std::memory_order::release); } // orders the reads of the node before its reclamation
+
+            guard(guard const&) = delete;
+            guard operator=(guard const&) = delete;
+
+            template < unsigned Index = 0, class U >
+            U* protect(std::atomic< U* > const& src, U* seen) {
+                static_assert(Index < protect_slots);
+                U* temp;
+                do {
+                    temp = seen;
+                    hp.store(seen); // seq_cst: a release store lets the load below pass it, see model_check.cpp
+                    seen = src.load();
+                } while (seen != temp);
+                return seen;
+            }
+
+            void retire(Node* old_head) {
+                hp.store(nullptr, std::memory_order::release);
+                if (machinery.outstanding_hazard_pointers_for(old_head)) {
+                    machinery.reclaim_later(old_head);
+                } else {
+                    Allocator::destroy(old_head);
+                }
+                machinery.delete_nodes_with_no_hazards();
+            }
+        };
+    };
+};
+
+// hazard_pointer_domain: slots reused per thread, retire lists scanned in batches
+struct hazard_domain_reclaimer {
+    inline static unsigned const protect_slots       = 2;
+    inline static bool const     keeps_retired_links = true;
+
+    template < class Node, class Allocator >
+    class domain {
+      public:
+        class guard {
+            std::optional< hazard_pointer_domain::guard > hp[protect_slots]; // slots are claimed on first use
+
+          public:
+            explicit guard(domain&) {}
+
+            template < unsigned Index = 0, class U >
+            U* protect(std::atomic< U* > const& src, U* seen) {
+                static_assert(Index < protect_slots);
+                if (!hp[Index]) { hp[Index].emplace(); }
+                return hp[Index]->protect(src, seen);
+            }
+
+            void retire(Node* n) {
+                for (auto& slot : hp) {
+                    if (slot) { slot->reset(); }
+                }
+                hazard_pointer_domain::retire< Allocator >(n);
+            }
+        };
+    };
+};
+
+// epoch_domain: a guard is a critical section, protect() has nothing to publish
+struct epoch_reclaimer {
+    inline static unsigned const protect_slots       = 2;
+    inline static bool const     keeps_retired_links = true;
+
+    template < class Node, class Allocator >
+    class domain {
+      public:
+        class guard {
+            epoch_domain::guard critical_section;
+
+          public:
+            explicit guard(domain&) {}
+
+            template < unsigned Index = 0, class U >
+            U* protect(std::atomic< U* > const&, U* seen) {
+                return seen;
+            }
+            void retire(Node* n) { epoch_domain::retire< Allocator >(n); }
+        };
+    };
+};
+
+// Listing 7.11: split reference counts live in the node pointers themselves, so the container is specialized for
+// this policy instead of going through a domain. CountedPtr is the layout of those pointers, see counted_node_ptr.h
+template < class CountedPtr = default_counted_ptr >
+struct basic_split_ref_count_reclaimer {
+    inline static unsigned const protect_slots       = 0;
+    inline static bool const     keeps_retired_links = true;
+};
+using split_ref_count_reclaimer = basic_split_ref_count_reclaimer<>;
@@ -1,16 +1,27 @@
-#include "lockfree_stack.h"
+#include "lockfree_bounded_queue.h"
+#include "lockfree_hash_map.h"
+#include "lockfree_priority_queue.h"
 #include "lockfree_queue.h"
+#include "lockfree_segmented_queue.h"
+#include "lockfree_stack.h"
+#include <memory>
+#include <string>
 
 // Test code-correctness
-template class lock_free_stack_7_2< int >;
-template class lock_free_stack_7_4< int >;
-template class lock_free_stack_7_6< int >;
-template class lock_free_stack_7_11< int >;
+// lock_free_stack_7_2, _7_4, _7_6, _7_11, _hazard_domain and _epoch are aliases of these
+template class lock_free_stack< int, leaking_reclaimer >;
+template class lock_free_stack< int, threads_in_pop_reclaimer >;
+template class lock_free_stack< int, hazard_pointer_reclaimer >;
+template class lock_free_stack< int, split_ref_count_reclaimer >;
+template class lock_free_stack< int, hazard_domain_reclaimer >;
+template class lock_free_stack< int, epoch_reclaimer >;
 
-template class lock_free_stack_7_2< float >;
-template class lock_free_stack_7_4< float >;
-template class lock_free_stack_7_6< float >;
-template class lock_free_stack_7_11< float >;
+template class lock_free_stack< float, leaking_reclaimer >;
+template class lock_free_stack< float, threads_in_pop_reclaimer >;
+template class lock_free_stack< float, hazard_pointer_reclaimer >;
+template class lock_free_stack< float, split_ref_count_reclaimer >;
+template class lock_free_stack< float, hazard_domain_reclaimer >;
+template class lock_free_stack< float, epoch_reclaimer >;
 
 template class lock_free_queue_7_13_SPSC< int >;
 template class lock_free_queue_RC_tail< int >;
@@ -18,6 +29,72 @@ template class lock_free_queue_RC_tail< int >;
 template class lock_free_queue_7_13_SPSC< float >;
 template class lock_free_queue_RC_tail< float >;
 
+template class lock_free_queue_RC_tail_modified< int >;
+template class lock_free_queue_bounded_MPMC< int >;
+template class lock_free_queue_ring_SPSC< int >;
+
+template class lock_free_queue_RC_tail_modified< float >;
+template class lock_free_queue_bounded_MPMC< float >;
+template class lock_free_queue_ring_SPSC< float >;
+
+template class lock_free_stack_inline< int >;
+template class lock_free_stack_inline< std::string >;
+template class lock_free_stack_inline< std::unique_ptr< int > >;
+template class lock_free_queue_RC_tail_inline< int >;
+template class lock_free_queue_RC_tail_inline< float >;
+template class lock_free_queue_RC_tail_inline< std::string >;
+template class lock_free_queue_RC_tail_inline< std::unique_ptr< int > >;
+template class lock_free_queue_MS< int, epoch_reclaimer >;
+template class lock_free_queue_MS< float, epoch_reclaimer >;
+template class lock_free_queue_MS< std::string, epoch_reclaimer >;
+template class lock_free_queue_MS< std::unique_ptr< int >, epoch_reclaimer >;
+template class lock_free_queue_MS< int, hazard_domain_reclaimer >;
+template class lock_free_queue_MS< std::string, hazard_domain_reclaimer >;
+template class lock_free_queue_MS< int, leaking_reclaimer >;
+template class lock_free_queue_segmented< int >;
+template class lock_free_queue_segmented< float >;
+template class lock_free_queue_segmented< std::string >;
+template class lock_free_queue_segmented< std::unique_ptr< int > >;
+template class lock_free_queue_segmented< int, hazard_domain_reclaimer, pooled_node_allocator, 32 >;
+
+template class lock_free_stack< int, threads_in_pop_reclaimer, new_delete_node_allocator >;
+template class lock_free_stack< int, hazard_pointer_reclaimer, new_delete_node_allocator >;
+template class lock_free_stack< int, split_ref_count_reclaimer, new_delete_node_allocator >;
+template class lock_free_stack< int, hazard_domain_reclaimer, new_delete_node_allocator >;
+template class lock_free_stack< int, epoch_reclaimer, new_delete_node_allocator >;
+template class lock_free_queue_MS< int, epoch_reclaimer, new_delete_node_allocator >;
+template class lock_free_queue_7_13_SPSC< int, new_delete_node_allocator >;
+template class lock_free_queue_RC_tail_modified< int, new_delete_node_allocator >;
+
+template class lock_free_stack< int, threads_in_pop_reclaimer, default_node_allocator, exponential_backoff<> >;
+template class lock_free_stack< int, split_ref_count_reclaimer, default_node_allocator, exponential_backoff<> >;
+template class lock_free_stack< int, hazard_domain_reclaimer, default_node_allocator, spin_then_yield_backoff<> >;
+template class lock_free_stack_inline< int, default_node_allocator, exponential_backoff<> >;
+template class lock_free_queue_RC_tail< int, default_node_allocator, exponential_backoff<> >;
+template class lock_free_queue_RC_tail_modified< int, default_node_allocator, exponential_backoff<> >;
+template class lock_free_queue_RC_tail_modified< int, default_node_allocator, spin_then_yield_backoff<> >;
+template class lock_free_queue_RC_tail_inline< int, default_node_allocator, spin_then_yield_backoff<> >;
+template class lock_free_queue_MS< int, epoch_reclaimer, default_node_allocator, exponential_backoff<> >;
+
+template class lock_free_stack< int, basic_split_ref_count_reclaimer< wide_counted_ptr > >;
+template class lock_free_queue_RC_tail< int, default_node_allocator, no_backoff, wide_counted_ptr >;
+template class lock_free_queue_RC_tail_modified< int, default_node_allocator, no_backoff, wide_counted_ptr >;
+template class lock_free_queue_RC_tail_inline< int, default_node_allocator, no_backoff, wide_counted_ptr >;
+
+template class lock_free_stack_elimination< int >;
+template class lock_free_stack_elimination< float, hazard_domain_reclaimer >;
+template class lock_free_stack_elimination< int, threads_in_pop_reclaimer, new_delete_node_allocator, 2 >;
+
+template class lock_free_hash_map< int, int >;
+template class lock_free_hash_map< std::string, std::string >;
+template class lock_free_hash_map< int, std::shared_ptr< int >, std::hash< int >, std::equal_to< int >, new_delete_node_allocator >;
+
+template class lock_free_skiplist< int, int >;
+template class lock_free_skiplist< std::string, std::string >;
+template class lock_free_skiplist< int, float, std::greater< int >, new_delete_node_allocator, 4 >;
+template class lock_free_priority_queue< int, int >;
+template class lock_free_priority_queue< double, std::unique_ptr< int > >;
+template class lock_free_priority_queue< int, std::string, std::greater< int >, new_delete_node_allocator >;
 
 int main() {
     // no-op
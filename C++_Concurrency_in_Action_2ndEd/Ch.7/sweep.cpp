@@ -0,0 +1,304 @@
+#include "benchmark.h"
+#include "lockfree_bounded_queue.h"
+#include "lockfree_queue.h"
+#include "lockfree_segmented_queue.h"
+#include "lockfree_stack.h"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Sweeps every stack and queue of this chapter, and a std::mutex baseline for each, over thread counts, payload sizes
+// and operation mixes. Prints one JSON array of results on stdout, meant to be kept per build and compared:
+//     Ch7_sweep [operations per thread = 50000] [max threads = max(4, hardware_concurrency())] > results.json
+// One operation in latency_sample_period is timed on its own; the percentiles are over those samples.
+
+unsigned const latency_sample_period = 64;
+
+template < std::size_t Size >
+struct payload {
+    static_assert(Size > sizeof(std::uint64_t));
+
+    std::uint64_t                                             sequence;
+    std::array< unsigned char, Size - sizeof(std::uint64_t) > padding {};
+};
+template <>
+struct payload< sizeof(std::uint64_t) > {
+    std::uint64_t sequence;
+};
+
+template < class T >
+class locked_stack {
+    std::mutex       mutex;
+    std::vector< T > items;
+
+  public:
+    void push(T const& value) {
+        std::lock_guard< std::mutex > lock(mutex);
+        items.push_back(value);
+    }
+    bool try_pop(T& value) {
+        std::lock_guard< std::mutex > lock(mutex);
+        if (items.empty()) { return false; }
+        value = items.back();
+        items.pop_back();
+        return true;
+    }
+};
+
+template < class T >
+class locked_queue {
+    std::mutex      mutex;
+    std::deque< T > items;
+
+  public:
+    void push(T const& value) {
+        std::lock_guard< std::mutex > lock(mutex);
+        items.push_back(value);
+    }
+    bool try_pop(T& value) {
+        std::lock_guard< std::mutex > lock(mutex);
+        if (items.empty()) { return false; }
+        value = items.front();
+        items.pop_front();
+        return true;
+    }
+};
+
+// The containers differ in how pop() hands values out and in whether push() can fail
+template < class Container, class T >
+bool try_push(Container& c, T const& value) {
+    if constexpr (requires { c.try_push(value); }) {
+        return c.try_push(value);
+    } else {
+        c.push(value);
+        return true;
+    }
+}
+template < class Container, class T >
+bool try_pop(Container& c, T& value) {
+    if constexpr (requires { c.try_pop(value); }) {
+        return c.try_pop(value);
+    } else {
+        auto const res = c.pop();
+        if (!res) { return false; }
+        value = *res;
+        return true;
+    }
+}
+
+// Latencies in nanoseconds of the sampled operations of one thread
+class latency_recorder {
+    std::vector< std::uint32_t > samples;
+    unsigned                     countdown = latency_sample_period;
+
+  public:
+    template < class Operation >
+    auto operator()(Operation op) {
+        if (--countdown) { return op(); }
+        countdown        = latency_sample_period;
+        auto const start = std::chrono::steady_clock::now();
+        auto const res   = op();
+        samples.push_back(static_cast< std::uint32_t >(std::chrono::duration_cast< std::chrono::nanoseconds >(std::chrono::steady_clock::now() - start).count()));
+        return res;
+    }
+
+    std::vector< std::uint32_t > const& values() const { return samples; }
+};
+
+struct run_result {
+    std::size_t                  operations;
+    double                       seconds;
+    std::vector< std::uint32_t > latencies;
+};
+
+class json_report {
+    bool first = true;
+
+  public:
+    json_report() { std::printf("[\n"); }
+    ~json_report() { std::printf("\n]\n"); }
+
+    // producers and consumers are 0 when every thread does both
+    void add(char const* container, std::size_t payload_size, char const* workload, unsigned threads, unsigned producers, unsigned consumers,
+             run_result& r) {
+        std::sort(r.latencies.begin(), r.latencies.end());
+        auto const percentile = [&](double p) -> unsigned {
+            return r.latencies.empty() ? 0 : r.latencies[std::min(r.latencies.size() - 1, static_cast< std::size_t >(p * r.latencies.size()))];
+        };
+        std::printf("%s  {\"container\": \"%s\", \"payload_bytes\": %zu, \"workload\": \"%s\", \"threads\": %u, \"producers\": %u, "
+                    "\"consumers\": %u, \"operations\": %zu, \"seconds\": %.6f, \"mops\": %.3f, "
+                    "\"latency_ns\": {\"p50\": %u, \"p99\": %u, \"p99.9\": %u}}",
+                    first ? "" : ",\n", container, payload_size, workload, threads, producers, consumers, r.operations, r.seconds,
+                    r.operations / r.seconds / 1e6, percentile(0.5), percentile(0.99), percentile(0.999));
+        std::fflush(stdout);
+        first = false;
+    }
+};
+
+// Every thread pushes push_percent of its operations and pops the rest, on a container prefilled with 1024 values
+template < class Container, class T >
+run_result run_mixed(unsigned threads, unsigned push_percent, std::size_t ops_per_thread) {
+    Container container;
+    for (std::uint64_t i = 0; i < 1024; ++i) { try_push(container, T { i }); }
+
+    std::vector< latency_recorder > recorders(threads);
+    double const                    seconds = run_concurrently(threads, [&](unsigned index) {
+        std::uint32_t state = 2654435761u * (index + 1); // xorshift32
+        T             value {};
+        for (std::size_t i = 0; i < ops_per_thread; ++i) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            if (state % 100 < push_percent) {
+                recorders[index]([&] { return try_push(container, T { i }); });
+            } else {
+                recorders[index]([&] { return try_pop(container, value); });
+            }
+        }
+    });
+    run_result res { threads * ops_per_thread, seconds, {} };
+    for (auto const& r : recorders) { res.latencies.insert(res.latencies.end(), r.values().begin(), r.values().end()); }
+    return res;
+}
+
+// producers push ops_per_thread values each, consumers pop them all; failed pops are retried and not counted
+template < class Container, class T >
+run_result run_handoff(unsigned producers, unsigned consumers, std::size_t ops_per_thread) {
+    Container                       container;
+    std::size_t const               total = producers * ops_per_thread;
+    std::atomic< std::size_t >      consumed { 0 };
+    std::vector< latency_recorder > recorders(producers + consumers);
+
+    double const seconds = run_concurrently(producers + consumers, [&](unsigned index) {
+        if (index < producers) {
+            for (std::size_t i = 0; i < ops_per_thread; ++i) {
+                recorders[index]([&] {
+                    while (!try_push(container, T { i })) { std::this_thread::yield(); }
+                    return true;
+                });
+            }
+        } else {
+            T value {};
+            while (consumed.load(std::memory_order::relaxed) < total) {
+                if (recorders[index]([&] { return try_pop(container, value); })) {
+                    consumed.fetch_add(1, std::memory_order::relaxed);
+                } else {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    });
+    run_result res { 2 * total, seconds, {} };
+    for (auto const& r : recorders) { res.latencies.insert(res.latencies.end(), r.values().begin(), r.values().end()); }
+    return res;
+}
+
+struct sweep_config {
+    std::size_t             ops_per_thread;
+    std::vector< unsigned > thread_counts;
+    json_report*            report;
+};
+
+// single_producer_consumer: only the one producer, one consumer hand-off applies
+template < template < class > class Container, class T >
+void sweep_container(char const* name, bool single_producer_consumer, sweep_config const& config) {
+    if (single_producer_consumer) {
+        run_result r = run_handoff< Container< T >, T >(1, 1, config.ops_per_thread);
+        config.report->add(name, sizeof(T), "handoff", 2, 1, 1, r);
+        return;
+    }
+    for (unsigned threads : config.thread_counts) {
+        for (unsigned push_percent : { 50u, 25u }) {
+            run_result        r        = run_mixed< Container< T >, T >(threads, push_percent, config.ops_per_thread);
+            std::string const workload = "mixed push=" + std::to_string(push_percent) + "%";
+            config.report->add(name, sizeof(T), workload.c_str(), threads, 0, 0, r);
+        }
+        if (threads < 2) { continue; }
+        std::vector< std::pair< unsigned, unsigned > > splits { { threads / 2, threads - threads / 2 } };
+        if (threads > 2) {
+            splits.emplace_back(1, threads - 1);
+            splits.emplace_back(threads - 1, 1);
+        }
+        for (auto const& [producers, consumers] : splits) {
+            run_result r = run_handoff< Container< T >, T >(producers, consumers, config.ops_per_thread);
+            config.report->add(name, sizeof(T), "handoff", threads, producers, consumers, r);
+        }
+    }
+}
+
+template < class T >
+using stack_7_2 = lock_free_stack_7_2< T >;
+template < class T >
+using stack_7_4 = lock_free_stack_7_4< T >;
+template < class T >
+using stack_7_6 = lock_free_stack_7_6< T >;
+template < class T >
+using stack_7_11 = lock_free_stack_7_11< T >;
+template < class T >
+using stack_hazard_domain = lock_free_stack_hazard_domain< T >;
+template < class T >
+using stack_epoch = lock_free_stack_epoch< T >;
+template < class T >
+using stack_inline = lock_free_stack_inline< T >;
+template < class T >
+using stack_elimination = lock_free_stack_elimination< T >;
+template < class T >
+using queue_7_13_SPSC = lock_free_queue_7_13_SPSC< T >;
+template < class T >
+using queue_RC_tail = lock_free_queue_RC_tail< T >;
+template < class T >
+using queue_RC_tail_modified = lock_free_queue_RC_tail_modified< T >;
+template < class T >
+using queue_RC_tail_inline = lock_free_queue_RC_tail_inline< T >;
+template < class T >
+using queue_MS_epoch = lock_free_queue_MS_epoch< T >;
+template < class T >
+using queue_MS_hazard_domain = lock_free_queue_MS< T, hazard_domain_reclaimer >;
+template < class T >
+using queue_segmented = lock_free_queue_segmented< T >;
+
+template < class T >
+void sweep_payload(sweep_config const& config) {
+    sweep_container< locked_stack, T >("std::vector + std::mutex", false, config);
+    sweep_container< stack_7_2, T >("lock_free_stack_7_2", false, config);
+    sweep_container< stack_7_4, T >("lock_free_stack_7_4", false, config);
+    sweep_container< stack_7_6, T >("lock_free_stack_7_6", false, config);
+    sweep_container< stack_7_11, T >("lock_free_stack_7_11", false, config);
+    sweep_container< stack_hazard_domain, T >("lock_free_stack_hazard_domain", false, config);
+    sweep_container< stack_epoch, T >("lock_free_stack_epoch", false, config);
+    sweep_container< stack_inline, T >("lock_free_stack_inline", false, config);
+    sweep_container< stack_elimination, T >("lock_free_stack_elimination", false, config);
+
+    sweep_container< locked_queue, T >("std::deque + std::mutex", false, config);
+    sweep_container< queue_7_13_SPSC, T >("lock_free_queue_7_13_SPSC", true, config);
+    sweep_container< queue_RC_tail, T >("lock_free_queue_RC_tail", false, config);
+    sweep_container< queue_RC_tail_modified, T >("lock_free_queue_RC_tail_modified", false, config);
+    sweep_container< queue_RC_tail_inline, T >("lock_free_queue_RC_tail_inline", false, config);
+    sweep_container< queue_MS_epoch, T >("lock_free_queue_MS_epoch", false, config);
+    sweep_container< queue_MS_hazard_domain, T >("lock_free_queue_MS<hazard_domain>", false, config);
+    sweep_container< queue_segmented, T >("lock_free_queue_segmented", false, config);
+    sweep_container< lock_free_queue_bounded_MPMC, T >("lock_free_queue_bounded_MPMC", false, config);
+    sweep_container< lock_free_queue_ring_SPSC, T >("lock_free_queue_ring_SPSC", true, config);
+}
+
+int main(int argc, char** argv) {
+    std::size_t const ops_per_thread = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 50'000;
+    unsigned const    max_threads    = argc > 2 ? static_cast< unsigned >(std::strtoul(argv[2], nullptr, 10)) : std::max(4u, std::thread::hardware_concurrency());
+
+    json_report  report;
+    sweep_config config { ops_per_thread, {}, &report };
+    for (unsigned threads = 1; threads <= max_threads; threads *= 2) { config.thread_counts.push_back(threads); }
+
+    sweep_payload< payload< 8 > >(config);
+    sweep_payload< payload< 64 > >(config);
+    sweep_payload< payload< 256 > >(config);
+}
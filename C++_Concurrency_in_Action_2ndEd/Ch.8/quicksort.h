@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../Ch.7/event_count.h"
 #include "../Ch.7/lockfree_stack.h"
 #include <algorithm>
 #include <atomic>
@@ -18,6 +19,7 @@ struct sorter_8_1 { // TODO: fix broken code?
     };
 
     lock_free_stack_7_6< chunk_to_sort > chunks;
+    event_count                          chunk_pushed; // sort threads sleep on it while chunks is empty
     std::vector< std::thread >           threads;
     unsigned const                       max_thread_count;
     std::atomic< bool >                  end_of_data;
@@ -26,6 +28,7 @@ struct sorter_8_1 { // TODO: fix broken code?
 
     ~sorter_8_1() {
         end_of_data = true;
+        chunk_pushed.notify_all();
 
         for (unsigned i = 0; i < threads.size(); ++i) { threads[i].join(); }
     }
@@ -49,6 +52,7 @@ struct sorter_8_1 { // TODO: fix broken code?
 
         auto new_lower = new_lower_chunk.promise.get_future();
         chunks.push(std::move(new_lower_chunk));
+        chunk_pushed.notify_one();
 
         if (threads.size() < max_thread_count) { threads.push_back(std::thread(&sorter_8_1< T >::sort_thread, this)); }
 
@@ -65,8 +69,9 @@ struct sorter_8_1 { // TODO: fix broken code?
 
     void sort_thread() {
         while (!end_of_data) {
-            try_sort_chunk();
-            std::this_thread::yield();
+            std::shared_ptr< chunk_to_sort > chunk;
+            chunk_pushed.await([&] { return end_of_data || (chunk = chunks.pop()) != nullptr; });
+            if (chunk) { sort_chunk(chunk); }
         }
     }
 };
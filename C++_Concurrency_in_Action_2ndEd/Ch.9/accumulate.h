@@ -14,7 +14,7 @@ T parallel_accumulate_9_3(Iter first, Iter last, T init) {
     unsigned long const             block_size = 25;
     unsigned long const             num_blocks = (length + block_size - 1) / block_size;
     std::vector< std::future< T > > futures(num_blocks - 1);
-    thread_pool_9_2                 pool;
+    thread_pool_9_2<>               pool;
     Iter                            block_start = first;
 
     for (unsigned long i = 0; i < (num_blocks - 1); ++i) {
@@ -0,0 +1,170 @@
+#include "pool_future.h"
+#include "task_group.h"
+#include "threadpool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+// Time from submit() on an idle pool to the start of the task: the pause before each sample lets the workers go to sleep
+template < class Pool >
+void bench_wakeup(char const* name, unsigned samples) {
+    Pool                     pool;
+    std::atomic< long long > started { 0 }; // outlives every task, a late notify_one() from the previous sample is harmless
+    std::vector< double >    latencies;
+    latencies.reserve(samples);
+
+    for (unsigned i = 0; i < samples; ++i) {
+        std::this_thread::sleep_for(2ms);
+        started.store(0);
+        auto const submitted = std::chrono::steady_clock::now();
+        pool.submit([&started] {
+            started.store(std::chrono::steady_clock::now().time_since_epoch().count());
+            started.notify_one();
+        });
+        started.wait(0);
+        auto const start = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(started.load()));
+        latencies.push_back(std::chrono::duration< double, std::micro >(start - submitted).count());
+    }
+    std::sort(latencies.begin(), latencies.end());
+    std::printf("%-40s wake-up latency p50=%8.1f us p99=%8.1f us\n", name, latencies[samples / 2], latencies[samples * 99 / 100]);
+}
+
+// Tasks per second through the injection queue: submitters threads outside the pool each submit empty tasks
+template < class Pool >
+void bench_submit(char const* name, unsigned submitters, unsigned tasks) {
+    std::atomic< unsigned > executed { 0 };
+    unsigned const          total = submitters * tasks;
+    auto const              start = std::chrono::steady_clock::now();
+    {
+        Pool                       pool;
+        std::vector< std::thread > threads;
+        for (unsigned i = 0; i < submitters; ++i) {
+            threads.emplace_back([&] {
+                for (unsigned j = 0; j < tasks; ++j) {
+                    pool.submit([&executed] { executed.fetch_add(1, std::memory_order::relaxed); });
+                }
+            });
+        }
+        for (auto& t : threads) { t.join(); }
+        while (executed.load(std::memory_order::relaxed) < total) { std::this_thread::yield(); }
+    }
+    double const seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-40s submitters=%-3u %8.3f Mtasks/s\n", name, submitters, total / seconds / 1e6);
+}
+
+// Tasks per second through the local queues: a task running on a worker submits tasks empty tasks, which go to the
+// queue of that worker and are taken back by it or stolen by the others
+template < class Pool >
+void bench_local_submit(char const* name, unsigned tasks) {
+    std::atomic< unsigned > executed { 0 };
+    auto const              start = std::chrono::steady_clock::now();
+    {
+        Pool pool;
+        pool.submit([&] {
+            for (unsigned j = 0; j < tasks; ++j) {
+                pool.submit([&executed] { executed.fetch_add(1, std::memory_order::relaxed); });
+            }
+        });
+        while (executed.load(std::memory_order::relaxed) < tasks) { std::this_thread::yield(); }
+    }
+    double const seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-40s local    %8.3f Mtasks/s\n", name, tasks / seconds / 1e6);
+}
+
+// Skewed fork-join: fib(n) forks fib(n - 1) as a task, computes fib(n - 2) itself and runs pending tasks until the fork
+// is done. The two branches differ in size at every level, so idle workers keep stealing
+template < class Pool >
+unsigned long long fork_join_fib(Pool& pool, unsigned n) {
+    if (n < 2) { return n; }
+    auto                     forked = pool.submit([&pool, n] { return fork_join_fib(pool, n - 1); });
+    unsigned long long const second = fork_join_fib(pool, n - 2);
+    while (forked.wait_for(0s) != std::future_status::ready) { pool.run_pending_task(); }
+    return forked.get() + second;
+}
+
+// The same with pool_future: no polling, and the shared states come from per-thread free lists
+template < class Pool >
+unsigned long long fork_join_fib_pool_future(Pool& pool, unsigned n) {
+    if (n < 2) { return n; }
+    pool_future< unsigned long long > forked = spawn(pool, [&pool, n] { return fork_join_fib_pool_future(pool, n - 1); });
+    unsigned long long const          second = fork_join_fib_pool_future(pool, n - 2);
+    return forked.get() + second;
+}
+
+// The same with a task_group: no future at all, the fork writes its result into the frame of its parent
+template < class Pool >
+unsigned long long fork_join_fib_task_group(Pool& pool, unsigned n) {
+    if (n < 2) { return n; }
+    unsigned long long first = 0;
+    task_group         group(pool);
+    group.run([&pool, &first, n] { first = fork_join_fib_task_group(pool, n - 1); });
+    unsigned long long const second = fork_join_fib_task_group(pool, n - 2);
+    group.wait();
+    return first + second;
+}
+
+template < class Pool, unsigned long long (*Fib)(Pool&, unsigned) = fork_join_fib< Pool > >
+void bench_fork_join(char const* name, unsigned workers, unsigned n) {
+    auto const   start   = std::chrono::steady_clock::now();
+    Pool         pool(workers);
+    auto const   res     = pool.submit([&pool, n] { return Fib(pool, n); }).get();
+    double const seconds = std::chrono::duration< double >(std::chrono::steady_clock::now() - start).count();
+    std::printf("%-40s workers=%-3u fib(%u)=%llu %8.3f s\n", name, workers, n, res, seconds);
+}
+
+// Process CPU time burnt by a pool with nothing to do, in cores
+template < class Pool >
+void bench_idle_cpu(char const* name, std::chrono::milliseconds period) {
+    Pool pool;
+    std::this_thread::sleep_for(50ms); // workers are past their spinning phase
+
+    std::clock_t const cpu_start  = std::clock();
+    auto const         wall_start = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(period);
+    double const cpu  = double(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    double const wall = std::chrono::duration< double >(std::chrono::steady_clock::now() - wall_start).count();
+    std::printf("%-40s idle CPU %6.2f of %u cores\n", name, cpu / wall, std::thread::hardware_concurrency());
+}
+
+int main(int argc, char** argv) {
+    unsigned const samples = argc > 1 ? static_cast< unsigned >(std::strtoul(argv[1], nullptr, 10)) : 200;
+
+    bench_wakeup< thread_pool_9_1<> >("thread_pool_9_1", samples);
+    bench_wakeup< thread_pool_9_2<> >("thread_pool_9_2", samples);
+    bench_wakeup< thread_pool_9_6<> >("thread_pool_9_6", samples);
+    bench_wakeup< thread_pool_9_8<> >("thread_pool_9_8", samples);
+
+    for (unsigned submitters : { 1u, 4u, 16u }) {
+        bench_submit< thread_pool_9_2<> >("thread_pool_9_2", submitters, 20'000);
+        bench_submit< thread_pool_9_2< multi_queue > >("thread_pool_9_2<multi_queue>", submitters, 20'000);
+        bench_submit< thread_pool_9_6<> >("thread_pool_9_6", submitters, 20'000);
+        bench_submit< thread_pool_9_6< multi_queue > >("thread_pool_9_6<multi_queue>", submitters, 20'000);
+        bench_submit< thread_pool_9_8<> >("thread_pool_9_8", submitters, 20'000);
+        bench_submit< thread_pool_9_8< multi_queue > >("thread_pool_9_8<multi_queue>", submitters, 20'000);
+    }
+
+    using thread_pool_9_8_locked = thread_pool_9_8< lock_free_queue_RC_tail_modified, work_stealing_queue_9_7 >;
+    for (int i = 0; i < 3; ++i) {
+        bench_local_submit< thread_pool_9_8<> >("thread_pool_9_8", 200'000);
+        bench_local_submit< thread_pool_9_8_locked >("thread_pool_9_8<work_stealing_queue_9_7>", 200'000);
+    }
+
+    for (unsigned workers : { 2u, std::max(4u, std::thread::hardware_concurrency()) }) {
+        bench_fork_join< thread_pool_9_8<> >("thread_pool_9_8", workers, 25);
+        bench_fork_join< thread_pool_9_8_locked >("thread_pool_9_8<work_stealing_queue_9_7>", workers, 25);
+        bench_fork_join< thread_pool_9_8<>, fork_join_fib_pool_future >("thread_pool_9_8 + pool_future", workers, 25);
+        bench_fork_join< thread_pool_9_8<>, fork_join_fib_task_group >("thread_pool_9_8 + task_group", workers, 25);
+    }
+
+    bench_idle_cpu< thread_pool_9_1<> >("thread_pool_9_1", 500ms);
+    bench_idle_cpu< thread_pool_9_2<> >("thread_pool_9_2", 500ms);
+    bench_idle_cpu< thread_pool_9_6<> >("thread_pool_9_6", 500ms);
+    bench_idle_cpu< thread_pool_9_8<> >("thread_pool_9_8", 500ms);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "task_group.h"
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <numeric>
+
+// The std::async based recursions of chapter 8 on a pool with a task_group: one half of the range goes to the pool,
+// the caller recurses on the other and helps until the forked half is done. Every level costs a posted task instead
+// of a thread and a future, so the pool has to be given, e.g. thread_pool_9_8.
+
+// Listing 8.5 parallel_accumulate
+template < class Pool, typename Iter, typename T >
+T parallel_accumulate_fork_join(Pool& pool, Iter first, Iter last, T init) {
+    unsigned long const length         = std::distance(first, last);
+    unsigned long const max_chunk_size = 25;
+
+    if (length <= max_chunk_size) { return std::accumulate(first, last, init); }
+
+    Iter mid_point = first;
+    std::advance(mid_point, length / 2);
+
+    T          first_half_result = init;
+    task_group group(pool);
+    group.run([&] { first_half_result = parallel_accumulate_fork_join(pool, first, mid_point, init); });
+    T const second_half_result = parallel_accumulate_fork_join(pool, mid_point, last, T {});
+    group.wait();
+
+    return first_half_result + second_half_result;
+}
+
+// Listing 8.8 parallel_for_each
+template < class Pool, typename Iter, typename Func >
+void parallel_for_each_fork_join(Pool& pool, Iter first, Iter last, Func f) {
+    unsigned long const length         = std::distance(first, last);
+    unsigned long const min_per_thread = 25;
+
+    if (length < (2 * min_per_thread)) {
+        std::for_each(first, last, f);
+        return;
+    }
+
+    Iter const mid_point = first + length / 2;
+    task_group group(pool);
+    group.run([&] { parallel_for_each_fork_join(pool, first, mid_point, f); });
+    parallel_for_each_fork_join(pool, mid_point, last, f);
+    group.wait();
+}
+
+// Listing 8.10 parallel_find, done stops the other halves once a match is found
+template < class Pool, typename Iter, typename MatchType >
+Iter parallel_find_fork_join_impl(Pool& pool, Iter first, Iter last, MatchType const& match, std::atomic< bool >& done) {
+    try {
+        unsigned long const length         = std::distance(first, last);
+        unsigned long const min_per_thread = 25;
+
+        if (length < (2 * min_per_thread)) {
+            for (; (first != last) && !done.load(); ++first) {
+                if (*first == match) {
+                    done = true;
+                    return first;
+                }
+            }
+            return last;
+        }
+
+        Iter const mid_point     = first + (length / 2);
+        Iter       second_result = last;
+        task_group group(pool);
+        group.run([&] { second_result = parallel_find_fork_join_impl(pool, mid_point, last, match, done); });
+        Iter const direct_result = parallel_find_fork_join_impl(pool, first, mid_point, match, done);
+        group.wait();
+        return (direct_result == mid_point) ? second_result : direct_result;
+    } catch (...) {
+        done = true;
+        throw;
+    }
+}
+template < class Pool, typename Iter, typename MatchType >
+Iter parallel_find_fork_join(Pool& pool, Iter first, Iter last, MatchType match) {
+    std::atomic< bool > done(false);
+    return parallel_find_fork_join_impl(pool, first, last, match, done);
+}
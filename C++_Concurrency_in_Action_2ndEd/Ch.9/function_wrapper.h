@@ -1,39 +1,97 @@
-#pragma once 
+#pragma once
 
-#include <memory>
+#include <cstddef>
+#include <new>
+#include <type_traits>
 #include <utility>
 
-class function_wrapper {
-    struct impl_base {
-        virtual void call() = 0;
-        virtual ~impl_base() {}
+// Move-only callable wrapper of listing 9.2. Callables of up to InlineSize bytes that are nothrow movable live in the
+// wrapper itself, bigger ones on the heap: a std::packaged_task fits, so submitting a task allocates its shared state
+// only. Calls go through a hand-rolled table of function pointers, one per callable type, instead of a virtual impl.
+template < std::size_t InlineSize = 48 >
+class basic_function_wrapper {
+    struct vtable {
+        void (*call)(void* storage);
+        void (*move)(void* from, void* to) noexcept; // move-constructs into to and destroys from
+        void (*destroy)(void* storage) noexcept;
     };
 
-    std::unique_ptr< impl_base > impl;
+    template < class F >
+    inline static constexpr bool stored_inline =
+        sizeof(F) <= InlineSize && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible_v< F >;
+
+    template < class F >
+    struct inline_vtable {
+        static F* get(void* storage) { return std::launder(static_cast< F* >(storage)); }
+
+        static void call(void* storage) { (*get(storage))(); }
+        static void move(void* from, void* to) noexcept {
+            ::new (to) F(std::move(*get(from)));
+            get(from)->~F();
+        }
+        static void destroy(void* storage) noexcept { get(storage)->~F(); }
+
+        inline static constexpr vtable table { &call, &move, &destroy };
+    };
 
     template < class F >
-    struct impl_type : impl_base {
-        F f;
-        impl_type(F&& f_) : f(std::move(f_)) {}
-        void call() { f(); }
+    struct heap_vtable {
+        static F*& get(void* storage) { return *std::launder(static_cast< F** >(storage)); }
+
+        static void call(void* storage) { (*get(storage))(); }
+        static void move(void* from, void* to) noexcept { ::new (to) F*(get(from)); }
+        static void destroy(void* storage) noexcept { delete get(storage); }
+
+        inline static constexpr vtable table { &call, &move, &destroy };
     };
 
+    alignas(std::max_align_t) unsigned char storage[InlineSize < sizeof(void*) ? sizeof(void*) : InlineSize];
+    vtable const*                           table = nullptr;
+
+    void reset() noexcept {
+        if (table) { table->destroy(storage); }
+        table = nullptr;
+    }
+
   public:
     template < class F >
-    function_wrapper(F&& f) : impl(new impl_type< F >(std::move(f))) {}
+        requires(!std::is_same_v< std::decay_t< F >, basic_function_wrapper >)
+    basic_function_wrapper(F&& f) {
+        using callable = std::decay_t< F >;
+        if constexpr (stored_inline< callable >) {
+            ::new (static_cast< void* >(storage)) callable(std::forward< F >(f));
+            table = &inline_vtable< callable >::table;
+        } else {
+            ::new (static_cast< void* >(storage)) callable*(new callable(std::forward< F >(f)));
+            table = &heap_vtable< callable >::table;
+        }
+    }
 
-    void operator()() { impl->call(); }
+    void operator()() { table->call(storage); }
 
-    function_wrapper() = default;
+    explicit operator bool() const { return table; }
 
-    function_wrapper(function_wrapper&& other) : impl(std::move(other.impl)) {}
+    basic_function_wrapper() = default;
+    ~basic_function_wrapper() { reset(); }
 
-    function_wrapper& operator=(function_wrapper&& other) {
-        impl = std::move(other.impl);
+    basic_function_wrapper(basic_function_wrapper&& other) noexcept : table(other.table) {
+        if (table) { table->move(other.storage, storage); }
+        other.table = nullptr;
+    }
+
+    basic_function_wrapper& operator=(basic_function_wrapper&& other) noexcept {
+        if (this != &other) {
+            reset();
+            table = other.table;
+            if (table) { table->move(other.storage, storage); }
+            other.table = nullptr;
+        }
         return *this;
     }
 
-    function_wrapper(const function_wrapper&) = delete;
-    function_wrapper(function_wrapper&)       = delete;
-    function_wrapper& operator=(const function_wrapper&) = delete;
+    basic_function_wrapper(const basic_function_wrapper&) = delete;
+    basic_function_wrapper(basic_function_wrapper&)       = delete;
+    basic_function_wrapper& operator=(const basic_function_wrapper&) = delete;
 };
+
+using function_wrapper = basic_function_wrapper<>;
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "../Ch.7/cache_line.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+// Relaxed FIFO queue sharded into ShardsPerThread * hardware_concurrency() locked sub-queues, meant as the injection
+// queue of a pool when many threads submit at once. A push goes to a random shard, a pop takes from the older head of
+// two random shards: with more shards than threads the try_lock on a shard almost never fails and the order is close
+// to FIFO, the oldest task being among the first ones taken.
+// try_pop() returns false only after it saw every shard empty, so a worker never goes to sleep with a task left.
+// see more about the technique: Hamza Rihani, Peter Sanders and Roman Dementiev, MultiQueues: simple relaxed
+// concurrent priority queues, 2015
+template < class T, unsigned ShardsPerThread = 2 >
+class multi_queue {
+    static_assert(ShardsPerThread > 0);
+
+  public:
+    inline static unsigned const sample_attempts = 8; // try_lock() of a push, pairs of shards of a pop, before blocking
+
+  private:
+    inline static std::uint64_t const empty_stamp = std::numeric_limits< std::uint64_t >::max();
+
+    struct entry {
+        std::uint64_t stamp;
+        T             value;
+    };
+    struct alignas(cache_line_size) shard {
+        std::atomic< std::uint64_t > oldest { empty_stamp }; // stamp of the front entry, read without the lock
+        std::mutex                   mutex;
+        std::deque< entry >          entries;
+    };
+
+    unsigned const             shard_count;
+    std::unique_ptr< shard[] > shards;
+
+    // xorshift32, one generator per thread
+    unsigned random_shard() const {
+        thread_local std::uint32_t state = static_cast< std::uint32_t >(std::hash< std::thread::id > {}(std::this_thread::get_id())) | 1;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state % shard_count;
+    }
+
+    // A clock read on each core rather than a counter shared by all producers
+    static std::uint64_t now() { return static_cast< std::uint64_t >(std::chrono::steady_clock::now().time_since_epoch().count()); }
+
+    // Call with s.mutex held
+    static bool take(shard& s, T& value) {
+        if (s.entries.empty()) { return false; }
+        value = std::move(s.entries.front().value);
+        s.entries.pop_front();
+        s.oldest.store(s.entries.empty() ? empty_stamp : s.entries.front().stamp, std::memory_order::relaxed);
+        return true;
+    }
+
+  public:
+    multi_queue() : shard_count(ShardsPerThread * std::max(std::thread::hardware_concurrency(), 1u)), shards(new shard[shard_count]) {}
+
+    multi_queue(const multi_queue&) = delete;
+    multi_queue operator=(const multi_queue&) = delete;
+
+    template < class... Args >
+    void emplace(Args&&... args) {
+        entry new_entry { now(), T(std::forward< Args >(args)...) };
+        shard*                         s = &shards[random_shard()];
+        std::unique_lock< std::mutex > lock(s->mutex, std::try_to_lock);
+        for (unsigned i = 1; !lock; ++i) {
+            s = &shards[random_shard()];
+            if (i < sample_attempts) {
+                lock = std::unique_lock< std::mutex >(s->mutex, std::try_to_lock);
+            } else {
+                lock = std::unique_lock< std::mutex >(s->mutex); // the holders may have been preempted, stop spinning
+            }
+        }
+        s->entries.push_back(std::move(new_entry));
+        if (s->entries.size() == 1) { s->oldest.store(s->entries.front().stamp, std::memory_order::relaxed); }
+    }
+    void push(T const& new_value) requires std::is_copy_constructible_v< T > { emplace(new_value); }
+    void push(T&& new_value) { emplace(std::move(new_value)); }
+
+    bool try_pop(T& value) {
+        for (unsigned i = 0; i < sample_attempts; ++i) {
+            shard&              first        = shards[random_shard()];
+            shard&              second       = shards[random_shard()];
+            std::uint64_t const first_oldest = first.oldest.load(std::memory_order::relaxed);
+            shard&              s            = second.oldest.load(std::memory_order::relaxed) < first_oldest ? second : first;
+            if (s.oldest.load(std::memory_order::relaxed) == empty_stamp) { continue; }
+            std::unique_lock< std::mutex > lock(s.mutex, std::try_to_lock);
+            if (lock && take(s, value)) { return true; }
+        }
+        for (unsigned i = 0; i < shard_count; ++i) { // few tasks in many shards, or none at all
+            shard& s = shards[i];
+            if (s.oldest.load(std::memory_order::relaxed) == empty_stamp) { continue; }
+            std::lock_guard< std::mutex > lock(s.mutex);
+            if (take(s, value)) { return true; }
+        }
+        return false;
+    }
+};
@@ -0,0 +1,228 @@
+#pragma once
+
+#include "../Ch.7/node_allocator.h"
+#include "function_wrapper.h"
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+// Task handle of the pools with try_run_pending_task() and post(), a lighter std::future for tasks that wait on tasks
+// - get() and wait() run pending tasks of the pool until the result is ready, and only block once there is nothing
+//   left to run, so a waiting worker keeps the pool busy and notices the result as soon as its last task returns
+// - then(f) schedules f on the pool with the result once it is ready, and returns the handle of f
+// - the shared state comes from the per-thread free lists of pooled_node_allocator, and a completion only touches the
+//   atomic word of the state unless someone blocks on it or registered a continuation
+//     pool_future< int > f = spawn(pool, [] { return 42; });
+//     pool_future< void > g = std::move(f).then([](int v) { use(v); });
+//     g.get();
+namespace pool_future_detail {
+
+// The pool a task runs on, without its type
+struct pool_ref {
+    void* pool;
+    void (*post)(void* pool, function_wrapper&& task);
+    bool (*try_run_pending_task)(void* pool);
+
+    template < class Pool >
+    static pool_ref of(Pool& pool) {
+        return { &pool, [](void* p, function_wrapper&& task) { static_cast< Pool* >(p)->post(std::move(task)); },
+                 [](void* p) { return static_cast< Pool* >(p)->try_run_pending_task(); } };
+    }
+};
+
+struct empty_value {};
+
+// Result of a continuation taking the value of a task, or nothing after a task returning void
+template < class Function, class T >
+struct continuation_result {
+    using type = std::invoke_result_t< Function&, T&& >;
+};
+template < class Function >
+struct continuation_result< Function, void > {
+    using type = std::invoke_result_t< Function& >;
+};
+
+template < class T >
+class shared_state {
+  public:
+    using value_type = std::conditional_t< std::is_void_v< T >, empty_value, T >;
+
+  private:
+    using allocator = pooled_node_allocator;
+
+    inline static unsigned const ready            = 1;
+    inline static unsigned const has_waiter       = 2;
+    inline static unsigned const has_continuation = 4;
+
+    std::atomic< unsigned >     status { 0 };
+    std::atomic< unsigned >     references { 2 }; // the handle and the producer
+    std::optional< value_type > value;
+    std::exception_ptr          error;
+    function_wrapper            continuation; // written by then() before it sets has_continuation
+
+  public:
+    pool_ref const pool;
+
+    explicit shared_state(pool_ref pool_) : pool(pool_) {}
+
+    static shared_state* create(pool_ref pool) { return allocator::create< shared_state >(pool); }
+
+    void release() {
+        if (references.fetch_sub(1, std::memory_order::acq_rel) == 1) { allocator::destroy(this); }
+    }
+
+    bool is_ready() const { return status.load(std::memory_order::acquire) & ready; }
+
+    // Producer side: runs f, stores its result or its exception, then drops the producer's reference
+    template < class Function, class... Args >
+    void fulfil(Function& f, Args&&... args) {
+        try {
+            if constexpr (std::is_void_v< T >) {
+                std::invoke(f, std::forward< Args >(args)...);
+                value.emplace();
+            } else {
+                value.emplace(std::invoke(f, std::forward< Args >(args)...));
+            }
+        } catch (...) { error = std::current_exception(); }
+        complete();
+    }
+    void fail(std::exception_ptr e) {
+        error = std::move(e);
+        complete();
+    }
+
+    void complete() {
+        unsigned const previous = status.fetch_or(ready, std::memory_order::acq_rel);
+        if (previous & has_continuation) { pool.post(pool.pool, std::move(continuation)); }
+        if (previous & has_waiter) { status.notify_all(); }
+        release();
+    }
+
+    // Consumer side
+    void block_until_ready() {
+        unsigned s = status.fetch_or(has_waiter, std::memory_order::acquire) | has_waiter;
+        while (!(s & ready)) {
+            status.wait(s, std::memory_order::acquire);
+            s = status.load(std::memory_order::acquire);
+        }
+    }
+
+    // The continuation runs on the pool once the state is ready, right away if it already is
+    void set_continuation(function_wrapper&& f) {
+        continuation = std::move(f);
+        if (status.fetch_or(has_continuation, std::memory_order::acq_rel) & ready) { pool.post(pool.pool, std::move(continuation)); }
+    }
+
+    value_type take() {
+        if (error) { std::rethrow_exception(error); }
+        return std::move(*value);
+    }
+    std::exception_ptr const& exception() const { return error; }
+};
+
+} // namespace pool_future_detail
+
+template < class T >
+class pool_future {
+    using state_type = pool_future_detail::shared_state< T >;
+
+    state_type* state = nullptr;
+
+    template < class U >
+    friend class pool_future;
+    template < class Pool, class FunctionType >
+    friend pool_future< std::invoke_result_t< FunctionType > > spawn(Pool& pool, FunctionType f);
+
+    explicit pool_future(state_type* s) : state(s) {}
+
+  public:
+    pool_future() = default;
+    ~pool_future() {
+        if (state) { state->release(); }
+    }
+
+    pool_future(pool_future&& other) noexcept : state(std::exchange(other.state, nullptr)) {}
+    pool_future& operator=(pool_future&& other) noexcept {
+        if (this != &other) {
+            if (state) { state->release(); }
+            state = std::exchange(other.state, nullptr);
+        }
+        return *this;
+    }
+
+    pool_future(pool_future const&) = delete;
+    pool_future& operator=(pool_future const&) = delete;
+
+    bool valid() const { return state; }
+    bool is_ready() const { return state->is_ready(); }
+
+    // Runs pending tasks of the pool until the result is ready, blocks only when there is none left to run
+    void wait() const {
+        while (!state->is_ready()) {
+            if (!state->pool.try_run_pending_task(state->pool.pool)) { state->block_until_ready(); }
+        }
+    }
+
+    // Waits, then returns the result or rethrows the exception of the task. The handle is empty afterwards
+    T get() {
+        wait();
+        state_type* const s = std::exchange(state, nullptr);
+        struct releaser {
+            state_type* s;
+            ~releaser() { s->release(); }
+        } const release_on_exit { s };
+        if constexpr (std::is_void_v< T >) {
+            s->take();
+        } else {
+            return s->take();
+        }
+    }
+
+    // Schedules f(result) on the pool once the result is ready, f() for a pool_future< void >. An exception of the
+    // task skips f and goes to the returned handle. The handle is empty afterwards
+    template < class Function >
+    auto then(Function f) && {
+        using result_type = typename pool_future_detail::continuation_result< Function, T >::type;
+        using next_state  = pool_future_detail::shared_state< result_type >;
+
+        next_state* const next       = next_state::create(state->pool);
+        state_type* const antecedent = std::exchange(state, nullptr);
+        try {
+            antecedent->set_continuation(function_wrapper([antecedent, next, f = std::move(f)]() mutable {
+                if (antecedent->exception()) {
+                    next->fail(antecedent->exception());
+                } else if constexpr (std::is_void_v< T >) {
+                    next->fulfil(f);
+                } else {
+                    next->fulfil(f, antecedent->take());
+                }
+                antecedent->release();
+            }));
+        } catch (...) { // the continuation never runs: drop the references it and the returned handle would have dropped
+            next->release();
+            next->release();
+            antecedent->release();
+            throw;
+        }
+        return pool_future< result_type >(next);
+    }
+};
+
+// Runs f on pool, which needs post() and try_run_pending_task()
+template < class Pool, class FunctionType >
+pool_future< std::invoke_result_t< FunctionType > > spawn(Pool& pool, FunctionType f) {
+    using state_type = pool_future_detail::shared_state< std::invoke_result_t< FunctionType > >;
+
+    state_type* const state = state_type::create(pool_future_detail::pool_ref::of(pool));
+    try {
+        pool.post([state, f = std::move(f)]() mutable { state->fulfil(f); });
+    } catch (...) { // neither the task nor a handle will release the state
+        state->release();
+        state->release();
+        throw;
+    }
+    return pool_future< std::invoke_result_t< FunctionType > >(state);
+}
@@ -1,15 +1,14 @@
 #pragma once
 
+#include "task_group.h"
 #include "threadpool.h"
 #include <list>
 #include <algorithm>
-#include <future>
-#include <chrono>
 
 // Listing 9.5 A thread poolbased implementation of Quicksort
 template < class T >
 struct thread_pool_sorter {
-    thread_pool_9_2 pool;
+    thread_pool_9_8<> pool;
 
     std::list< T > do_sort(std::list< T >& chunk_data) {
         if (chunk_data.empty()) { return chunk_data; }
@@ -24,14 +23,16 @@ struct thread_pool_sorter {
 
         new_lower_chunk.splice(new_lower_chunk.end(), chunk_data, chunk_data.begin(), divide_point);
 
-        std::future< std::list< T > > new_lower = pool.submit(std::bind(&thread_pool_sorter::do_sort, this, std::move(new_lower_chunk)));
-        std::list< T >                new_higher(do_sort(chunk_data));
+        // a task_group instead of a future polled every 100us like the listing: the lower half goes to the local deque of
+        // the worker, and wait() runs pending tasks until it is sorted
+        std::list< T > new_lower;
+        task_group     group(pool);
+        group.run([&] { new_lower = do_sort(new_lower_chunk); });
+        std::list< T > new_higher(do_sort(chunk_data));
+        group.wait();
 
         result.splice(result.end(), new_higher);
-
-        while (new_lower.wait_for(std::chrono::microseconds(100)) != std::future_status::ready) { pool.run_pending_task(); }
-
-        result.splice(result.begin(), new_lower.get());
+        result.splice(result.begin(), new_lower);
 
         return result;
     }
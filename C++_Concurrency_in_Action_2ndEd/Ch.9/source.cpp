@@ -1,11 +1,26 @@
 #include "accumulate.h"
+#include "fork_join.h"
 #include "interruptible_thread.h"
+#include "pool_future.h"
 #include "quicksort.h"
 #include "threadpool.h"
 #include <cassert>
 
 #include <random>
 
+// Test code-correctness
+template class thread_pool_9_1< lock_free_queue_bounded_MPMC >;
+template class thread_pool_9_2< lock_free_queue_bounded_MPMC >;
+template class thread_pool_9_6< lock_free_queue_bounded_MPMC >;
+template class thread_pool_9_8< lock_free_queue_bounded_MPMC >;
+template class thread_pool_9_2< multi_queue >;
+template class thread_pool_9_6< multi_queue >;
+template class thread_pool_9_8< multi_queue >;
+template class thread_pool_9_8< lock_free_queue_RC_tail_modified, work_stealing_queue_9_7 >;
+template class pool_future< int >;
+template class pool_future< void >;
+template class task_group< thread_pool_9_8<> >;
+
 // Listing 9.13 Monitoring the filesystem in the background
 std::mutex                              config_mutex;
 std::vector< interruptible_thread_9_9 > background_threads;
@@ -64,5 +79,19 @@ int main() {
         res.pop_front();
     }
 
+    {
+        thread_pool_9_8<> pool;
+        auto chained = spawn(pool, [] { return 20; }).then([](int v) { return v + 1; }).then([](int v) { return v * 2; });
+        assert(chained.get() == 42);
+
+        std::vector< int > values(1000);
+        std::iota(values.begin(), values.end(), 1);
+        assert(parallel_accumulate_fork_join(pool, values.begin(), values.end(), 0) == 500500);
+        parallel_for_each_fork_join(pool, values.begin(), values.end(), [](int& v) { v *= 2; });
+        assert(parallel_accumulate_fork_join(pool, values.begin(), values.end(), 0) == 1001000);
+        assert(*parallel_find_fork_join(pool, values.begin(), values.end(), 1234) == 1234);
+        assert(parallel_find_fork_join(pool, values.begin(), values.end(), 1235) == values.end());
+    }
+
     run_9_13();
 }
\ No newline at end of file
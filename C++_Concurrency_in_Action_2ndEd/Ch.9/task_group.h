@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <utility>
+
+// Fork-join on the pools with post() and try_run_pending_task(), thread_pool_9_8 foremost
+// - run(f) posts f: from a worker of thread_pool_9_8 it lands on the worker's own deque, where it is popped again
+//   right away unless an idle worker steals it first
+// - wait() runs pending tasks of the pool until every f is done, and only blocks once there is none left to run
+// - no std::future, no packaged task: a child task is f plus a pointer to the group, and completing it is one
+//   fetch_sub on the group unless the joining thread sleeps on it
+// - the first exception thrown by a child is rethrown by wait(), the others are dropped
+// - the destructor waits too, so children may refer to locals of the scope of the group
+//     task_group group(pool);
+//     group.run([&] { left = sort(lower); });
+//     right = sort(higher);
+//     group.wait();
+// see more about the technique: Robert D. Blumofe et al., Cilk: An Efficient Multithreaded Runtime System, 1995
+template < class Pool >
+class task_group {
+    // pending children counted in steps of 2, the low bit tells that the joining thread sleeps on state
+    inline static unsigned const waiting = 1;
+    inline static unsigned const child   = 2;
+
+    Pool&                   pool;
+    std::atomic< unsigned > state { 0 };
+    std::atomic< bool >     failed { false };
+    std::exception_ptr      error; // written by the child that sets failed
+
+    // The last child wakes the joining thread and only then clears waiting: the joining thread, and with it the group,
+    // does not leave join() while the child still touches state
+    void finish_child() {
+        if (state.fetch_sub(child, std::memory_order::acq_rel) == (child | waiting)) {
+            state.notify_all();
+            state.store(0, std::memory_order::release);
+        }
+    }
+
+    void join() noexcept {
+        while (state.load(std::memory_order::acquire) >= child) {
+            if (pool.try_run_pending_task()) { continue; }
+            unsigned const previous = state.fetch_or(waiting, std::memory_order::acquire);
+            if (previous < child) { // the last child finished meanwhile, nobody else clears waiting
+                state.store(0, std::memory_order::relaxed);
+                return;
+            }
+            unsigned s = previous | waiting;
+            while (s >= child) {
+                state.wait(s, std::memory_order::acquire);
+                s = state.load(std::memory_order::acquire);
+            }
+            while (s != 0) {
+                std::this_thread::yield();
+                s = state.load(std::memory_order::acquire);
+            }
+        }
+    }
+
+  public:
+    explicit task_group(Pool& pool_) : pool(pool_) {}
+    ~task_group() { join(); }
+
+    task_group(task_group const&) = delete;
+    task_group operator=(task_group const&) = delete;
+
+    template < class Function >
+    void run(Function f) {
+        state.fetch_add(child, std::memory_order::relaxed);
+        try {
+            pool.post([this, f = std::move(f)]() mutable {
+                try {
+                    f();
+                } catch (...) {
+                    if (!failed.exchange(true, std::memory_order::relaxed)) { error = std::current_exception(); }
+                }
+                finish_child();
+            });
+        } catch (...) {
+            finish_child();
+            throw;
+        }
+    }
+
+    // Returns once every child is done, rethrows the first exception of a child
+    void wait() {
+        join();
+        if (failed.load(std::memory_order::relaxed)) {
+            failed.store(false, std::memory_order::relaxed);
+            std::rethrow_exception(std::exchange(error, nullptr));
+        }
+    }
+};
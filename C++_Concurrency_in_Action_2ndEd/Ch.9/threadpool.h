@@ -1,20 +1,43 @@
 #pragma once
 
+#include "../Ch.7/event_count.h"
+#include "../Ch.7/lockfree_bounded_queue.h"
 #include "../Ch.7/lockfree_queue.h"
 #include "../Ch.8/jointhreads.h"
 #include "function_wrapper.h"
+#include "multi_queue.h"
 #include "work_stealing_queue.h"
+#include <algorithm>
 #include <atomic>
+#include <cstdint>
+#include <functional>
 #include <future>
+#include <memory>
 #include <queue>
 #include <thread>
 #include <vector>
 
-#define MEMBERS(WorkItem)                                    \
-    std::atomic_bool                             done;       \
-    lock_free_queue_RC_tail_modified< WorkItem > work_queue; \
-    std::vector< std::thread >                   threads;    \
-    join_threads                                 joiner;
+// The pools take their global (injection) queue as a template template parameter, any queue offering
+// push(WorkItem&&) and bool try_pop(WorkItem&) fits, e.g. lock_free_queue_bounded_MPMC to avoid per-task node allocations
+// or multi_queue when many threads submit at once.
+// A queue with bool try_push(WorkItem&&) is taken as bounded: a submitter facing a full queue runs pending tasks until
+// there is room, so workers submitting from inside tasks keep draining it instead of all waiting for each other.
+// Idle workers spin briefly and then sleep on work_available, submit() wakes one of them.
+template < class Queue, class WorkItem, class RunPendingTask >
+void inject(Queue& queue, WorkItem&& item, RunPendingTask run_pending_task) {
+    if constexpr (requires { queue.try_push(std::move(item)); }) {
+        while (!queue.try_push(std::move(item))) { run_pending_task(); } // item is only moved from by a push that succeeds
+    } else {
+        queue.push(std::move(item));
+    }
+}
+
+#define MEMBERS(WorkItem)                      \
+    std::atomic_bool           done;           \
+    InjectionQueue< WorkItem > work_queue;     \
+    event_count                work_available; \
+    std::vector< std::thread > threads;        \
+    join_threads               joiner;
 
 #define CTOR_DTOR(class_name)                                                                                                 \
     class_name() : done(false), joiner(threads) {                                                                             \
@@ -25,24 +48,36 @@
             for (unsigned i = 0; i < thread_count; ++i) { threads.push_back(std::thread(&class_name::worker_thread, this)); } \
         } catch (...) {                                                                                                       \
             done = true;                                                                                                      \
+            work_available.notify_all();                                                                                      \
             throw;                                                                                                            \
         }                                                                                                                     \
     }                                                                                                                         \
                                                                                                                               \
-    ~class_name() { done = true; }
+    ~class_name() {                                                                                                           \
+        done = true;                                                                                                          \
+        work_available.notify_all();                                                                                          \
+    }
 
-// Listing 9.1 Simple thread pool
+// Listing 9.1 Simple thread pool, with the function_wrapper of listing 9.2 instead of std::function: no allocation
+// for small callables
+template < template < class > class InjectionQueue = lock_free_queue_RC_tail_modified >
 class thread_pool_9_1 final {
-    MEMBERS(std::function< void() >)
+    MEMBERS(function_wrapper)
 
     void worker_thread() {
         while (!done) {
-            auto task = work_queue.pop();
-            if (task) {
-                (*task)();
-            } else {
-                std::this_thread::yield();
-            }
+            function_wrapper task;
+            work_available.await([&] { return done || work_queue.try_pop(task); });
+            if (task) { task(); }
+        }
+    }
+
+    void run_pending_task() {
+        function_wrapper task;
+        if (work_queue.try_pop(task)) {
+            task();
+        } else {
+            std::this_thread::yield();
         }
     }
 
@@ -51,28 +86,44 @@ class thread_pool_9_1 final {
 
     template < class FunctionType >
     void submit(FunctionType f) {
-        work_queue.push(std::function< void() >(f));
+        inject(work_queue, function_wrapper(std::move(f)), [this] { run_pending_task(); });
+        work_available.notify_one();
     }
 };
 
 // Listing 9.2 A thread pool with waitable tasks
+template < template < class > class InjectionQueue = lock_free_queue_RC_tail_modified >
 class thread_pool_9_2 final {
     MEMBERS(function_wrapper)
 
     void worker_thread() {
-        while (!done) { run_pending_task(); }
+        while (!done) {
+            function_wrapper task;
+            bool             popped = false;
+            work_available.await([&] { return done || (popped = work_queue.try_pop(task)); });
+            if (popped) { task(); }
+        }
     }
 
   public:
     CTOR_DTOR(thread_pool_9_2)
 
+    // For threads outside the pool waiting on a task: runs one pending task if there is one, never blocks
+    bool try_run_pending_task() {
+        function_wrapper task;
+        if (!work_queue.try_pop(task)) { return false; }
+        task();
+        return true;
+    }
     void run_pending_task() {
-        auto task = work_queue.pop();
-        if (task) {
-            (*task)();
-        } else {
-            std::this_thread::yield();
-        }
+        if (!try_run_pending_task()) { std::this_thread::yield(); }
+    }
+
+    // Queues f without a std::future, for callers tracking completion themselves (see pool_future.h)
+    template < class FunctionType >
+    void post(FunctionType f) {
+        inject(work_queue, function_wrapper(std::move(f)), [this] { run_pending_task(); });
+        work_available.notify_one();
     }
 
     template < class FunctionType >
@@ -81,107 +132,174 @@ class thread_pool_9_2 final {
 
         std::packaged_task< result_type() > task(std::move(f));
         std::future< result_type >          res(task.get_future());
-        work_queue.push(std::move(task));
+        post(std::move(task));
 
         return res;
     }
 };
 
 // Listing 9.6 A thread pool with thread-local work queues
+template < template < class > class InjectionQueue = lock_free_queue_RC_tail_modified >
 class thread_pool_9_6 final {
     MEMBERS(function_wrapper)
 
     using local_queue_type = std::queue< function_wrapper >;
-    static thread_local std::unique_ptr< local_queue_type > local_work_queue;
+    inline static thread_local std::unique_ptr< local_queue_type > local_work_queue;
 
     void worker_thread() {
         local_work_queue.reset(new local_queue_type);
 
-        while (!done) { run_pending_task(); }
+        while (!done) {
+            function_wrapper task;
+            bool             popped = false;
+            work_available.await([&] { return done || (popped = pop_task(task)); });
+            if (popped) { task(); }
+        }
+    }
+
+    bool pop_task(function_wrapper& task) {
+        if (local_work_queue && !local_work_queue->empty()) {
+            task = std::move(local_work_queue->front());
+            local_work_queue->pop();
+            return true;
+        }
+        return work_queue.try_pop(task);
     }
 
   public:
     CTOR_DTOR(thread_pool_9_6)
 
+    // Queues f without a std::future, for callers tracking completion themselves (see pool_future.h)
+    template < class FunctionType >
+    void post(FunctionType f) {
+        if (local_work_queue) {
+            local_work_queue->push(function_wrapper(std::move(f))); // only this worker runs it, nobody to wake
+        } else {
+            inject(work_queue, function_wrapper(std::move(f)), [this] { run_pending_task(); });
+            work_available.notify_one();
+        }
+    }
+
     template < class FunctionType >
     std::future< std::invoke_result_t< FunctionType > > submit(FunctionType f) {
         using result_type = typename std::invoke_result_t< FunctionType >;
         std::packaged_task< result_type() > task(f);
         std::future< result_type >          res(task.get_future());
-        if (local_work_queue) {
-            local_work_queue->push(std::move(task));
-        } else {
-            work_queue.push(std::move(task));
-        }
+        post(std::move(task));
         return res;
     }
 
+    // For threads waiting on a task: runs one pending task if there is one, never blocks
+    bool try_run_pending_task() {
+        function_wrapper task;
+        if (!pop_task(task)) { return false; }
+        task();
+        return true;
+    }
     void run_pending_task() {
-        function_wrapper                    task;
-        std::unique_ptr< function_wrapper > task_ptr { nullptr };
-        if (local_work_queue && !local_work_queue->empty()) {
-            task = std::move(local_work_queue->front());
-            local_work_queue->pop();
-            task();
-        } else if (task_ptr = work_queue.pop()) {
-            (*task_ptr)();
-        } else {
-            std::this_thread::yield();
-        }
+        if (!try_run_pending_task()) { std::this_thread::yield(); }
     }
 };
 
 // Listing 9.8 A thread pool that uses work stealing
+// LocalQueue is the queue of each worker, work_stealing_queue_9_7 of the book or the lock-free
+// work_stealing_queue_chase_lev: any class with push(function_wrapper&&), try_pop(), try_steal() and size()
+// A worker out of tasks steals from the other workers, starting with a random one so idle workers spread over the
+// victims, and moves up to half of the victim's tasks to its own queue: a fine-grained workload pays one victim search
+// per batch instead of one per task. Only the worker loop moves batches, a thread helping from inside a task steals a
+// single one (see try_run_pending_task). After steal_rounds failed rounds it parks on work_available.
+template < template < class > class InjectionQueue = lock_free_queue_RC_tail_modified, class LocalQueue = work_stealing_queue_chase_lev >
 class thread_pool_9_8 final {
+  public:
+    inline static unsigned const    steal_rounds    = 16;
+    inline static std::size_t const max_steal_batch = 32; // tasks moved on top of the one the thief runs
+    inline static unsigned const    max_help_depth  = 16; // foreign tasks a waiting thread nests on its stack
 
+  private:
     using task_type = function_wrapper;
 
-    std::atomic_bool                                          done;
-    lock_free_queue_RC_tail_modified< task_type >             work_queue;
-    std::vector< std::unique_ptr< work_stealing_queue_9_7 > > queues;
-    std::vector< std::thread >                                threads;
-    join_threads                                              joiner;
+    std::atomic_bool                             done;
+    InjectionQueue< task_type >                  work_queue;
+    event_count                                  work_available;
+    std::vector< std::unique_ptr< LocalQueue > > queues;
+    std::vector< std::thread >                   threads;
+    join_threads                                 joiner;
 
-    static thread_local work_stealing_queue_9_7* local_work_queue;
-    static thread_local unsigned                 my_index;
+    inline static thread_local LocalQueue* local_work_queue;
+    inline static thread_local unsigned    my_index;
+    inline static thread_local unsigned    help_depth;
 
     void worker_thread(unsigned my_index_) {
         my_index         = my_index_;
         local_work_queue = queues[my_index].get();
-        while (!done) { run_pending_task(); }
+        while (!done) {
+            task_type task;
+            bool      popped = false;
+            work_available.await([&] { return done || (popped = pop_task(task)); }, steal_rounds);
+            if (popped) { task(); }
+        }
+    }
+    bool pop_task(task_type& task) {
+        return pop_task_from_local_queue(task) || pop_task_from_pool_queue(task) || pop_task_from_other_thread_queue(task, true);
     }
     bool pop_task_from_local_queue(task_type& task) { return local_work_queue && local_work_queue->try_pop(task); }
-    bool pop_task_from_pool_queue(task_type& task) {
-        auto task_ptr = work_queue.pop();
-        if (task_ptr) {
-            task = std::move(*task_ptr.get());
-            return true;
+    bool pop_task_from_pool_queue(task_type& task) { return work_queue.try_pop(task); }
+    // Every other queue is tried once, so a worker never parks while a task is left to steal
+    bool pop_task_from_other_thread_queue(task_type& task, bool batch) {
+        if (queues.empty()) { return false; }
+        unsigned const start = random_index();
+        for (unsigned i = 0; i < queues.size(); ++i) {
+            unsigned const index = (start + i) % queues.size();
+            if (queues[index].get() != local_work_queue && steal_from(*queues[index], task, batch)) { return true; }
         }
-
         return false;
     }
-    bool pop_task_from_other_thread_queue(task_type& task) {
-        for (unsigned i = 0; i < queues.size(); ++i) {
-            unsigned const index = (my_index + i + 1) % queues.size();
-            if (queues[index]->try_steal(task)) { return true; }
+    bool steal_from(LocalQueue& victim, task_type& task, bool batch) {
+        if (!victim.try_steal(task)) { return false; }
+        if (batch && local_work_queue) { // threads outside the pool take one task
+            task_type   extra;
+            std::size_t count = std::min(victim.size() / 2, max_steal_batch);
+            while (count-- && victim.try_steal(extra)) { local_work_queue->push(std::move(extra)); }
         }
-        return false;
+        return true;
+    }
+
+    // xorshift32, one generator per thread
+    unsigned random_index() const {
+        thread_local std::uint32_t state = static_cast< std::uint32_t >(std::hash< std::thread::id > {}(std::this_thread::get_id())) | 1;
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state % queues.size();
     }
 
   public:
-    thread_pool_9_8() : done(false), joiner(threads) {
-        unsigned const thread_count = std::thread::hardware_concurrency();
+    explicit thread_pool_9_8(unsigned thread_count = std::thread::hardware_concurrency()) : done(false), joiner(threads) {
         try {
-            for (unsigned i = 0; i < thread_count; ++i) {
-                queues.push_back(std::unique_ptr< work_stealing_queue_9_7 >(new work_stealing_queue_9_7));
-                threads.push_back(std::thread(&thread_pool_9_8::worker_thread, this, i));
-            }
+            // every queue exists before the first worker starts stealing from them
+            for (unsigned i = 0; i < thread_count; ++i) { queues.push_back(std::unique_ptr< LocalQueue >(new LocalQueue)); }
+            for (unsigned i = 0; i < thread_count; ++i) { threads.push_back(std::thread(&thread_pool_9_8::worker_thread, this, i)); }
         } catch (...) {
             done = true;
+            work_available.notify_all();
             throw;
         }
     }
-    ~thread_pool_9_8() { done = true; }
+    ~thread_pool_9_8() {
+        done = true;
+        work_available.notify_all();
+    }
+
+    // Queues f without a std::future, for callers tracking completion themselves (see pool_future.h)
+    template < class FunctionType >
+    void post(FunctionType f) {
+        if (local_work_queue) {
+            local_work_queue->push(task_type(std::move(f)));
+        } else {
+            inject(work_queue, task_type(std::move(f)), [this] { run_pending_task(); });
+        }
+        work_available.notify_one(); // a local task can be stolen by an idle worker
+    }
 
     template < class FunctionType >
     std::future< std::invoke_result_t< FunctionType > > submit(FunctionType f) {
@@ -189,19 +307,29 @@ class thread_pool_9_8 final {
 
         std::packaged_task< result_type() > task(f);
         std::future< result_type >          res(task.get_future());
-        if (local_work_queue) {
-            local_work_queue->push(std::move(task));
-        } else {
-            work_queue.push(std::move(task));
-        }
+        post(std::move(task));
         return res;
     }
-    void run_pending_task() {
+    // For threads waiting on a task: runs one pending task if there is one, never blocks
+    // The local queue holds tasks posted by frames on this stack, plus at most max_steal_batch foreign ones moved by the
+    // worker loop before the stack held anything: helping never steals a batch. Any other task may wait in turn and nest
+    // a whole foreign subtree, so past max_help_depth of those the waiting thread only takes local tasks. Its stack
+    // stays within max_help_depth + max_steal_batch times the depth of the recursion
+    bool try_run_pending_task() {
         task_type task;
-        if (pop_task_from_local_queue(task) || pop_task_from_pool_queue(task) || pop_task_from_other_thread_queue(task)) {
+        if (pop_task_from_local_queue(task)) {
             task();
-        } else {
-            std::this_thread::yield();
+            return true;
         }
+        if (help_depth == max_help_depth || !(pop_task_from_pool_queue(task) || pop_task_from_other_thread_queue(task, false))) { return false; }
+        struct nesting {
+            nesting() { ++help_depth; }
+            ~nesting() { --help_depth; }
+        } const nested;
+        task();
+        return true;
+    }
+    void run_pending_task() {
+        if (!try_run_pending_task()) { std::this_thread::yield(); }
     }
 };
@@ -1,8 +1,16 @@
 #pragma once
 
+#include "../Ch.7/cache_line.h"
+#include "../Ch.7/node_allocator.h"
 #include "function_wrapper.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <deque>
+#include <memory>
 #include <mutex>
+#include <type_traits>
+#include <vector>
 
 // Listing 9.7 Lock-based queue for work stealing
 class work_stealing_queue_9_7 {
@@ -26,6 +34,10 @@ class work_stealing_queue_9_7 {
         std::scoped_lock lock(the_mutex);
         return the_queue.empty();
     }
+    std::size_t size() const {
+        std::scoped_lock lock(the_mutex);
+        return the_queue.size();
+    }
     bool try_pop(data_type& res) {
         std::scoped_lock lock(the_mutex);
 
@@ -48,4 +60,142 @@ class work_stealing_queue_9_7 {
 
         return true;
     }
-};
\ No newline at end of file
+};
+
+// Lock-free work-stealing deque over a growable circular array. The owner pushes and pops at bottom, thieves steal at
+// top. The owner's push() and try_pop() are plain loads and stores plus fences, the only RMW is the CAS on top that
+// settles a race for the last element. Thieves CAS on top.
+// Arrays replaced by a bigger one stay allocated until the deque is destroyed, since a thief may still be reading one.
+// T is copied by thieves before their CAS decides who owns it, so it has to be trivially copyable.
+// see more about the technique: David Chase and Yossi Lev, Dynamic Circular Work-Stealing Deque, 2005
+//                               Nhat Minh Le, Antoniu Pop, Albert Cohen and Francesco Zappa Nardelli, Correct and
+//                               Efficient Work-Stealing for Weak Memory Models, 2013
+template < class T, std::size_t InitialCapacity = 64 >
+class chase_lev_deque {
+    static_assert(std::is_trivially_copyable_v< T >);
+    static_assert(InitialCapacity > 0 && (InitialCapacity & (InitialCapacity - 1)) == 0, "InitialCapacity must be a power of 2");
+
+    struct circular_array {
+        std::size_t const                     mask;
+        std::unique_ptr< std::atomic< T >[] > slots;
+
+        explicit circular_array(std::size_t capacity) : mask(capacity - 1), slots(new std::atomic< T >[capacity]) {}
+
+        std::size_t capacity() const { return mask + 1; }
+        T           get(std::int64_t i) const { return slots[static_cast< std::size_t >(i) & mask].load(std::memory_order::relaxed); }
+        void        put(std::int64_t i, T value) { slots[static_cast< std::size_t >(i) & mask].store(value, std::memory_order::relaxed); }
+    };
+
+    alignas(cache_line_size) std::atomic< std::int64_t > top { 0 };    // next index to steal, only ever increases
+    alignas(cache_line_size) std::atomic< std::int64_t > bottom { 0 }; // next index to push, written by the owner only
+    std::atomic< circular_array* >                       array;
+    std::vector< std::unique_ptr< circular_array > >     arrays; // every array allocated, owner only
+
+    circular_array* grow(circular_array* a, std::int64_t b, std::int64_t t) {
+        arrays.push_back(std::make_unique< circular_array >(2 * a->capacity()));
+        circular_array* const bigger = arrays.back().get();
+        for (std::int64_t i = t; i < b; ++i) { bigger->put(i, a->get(i)); }
+        array.store(bigger, std::memory_order::release);
+        return bigger;
+    }
+
+  public:
+    chase_lev_deque() {
+        arrays.push_back(std::make_unique< circular_array >(InitialCapacity));
+        array.store(arrays.back().get(), std::memory_order::relaxed);
+    }
+
+    chase_lev_deque(const chase_lev_deque&) = delete;
+    chase_lev_deque& operator=(const chase_lev_deque&) = delete;
+
+    // Owner only
+    void push(T value) {
+        std::int64_t const b = bottom.load(std::memory_order::relaxed);
+        std::int64_t const t = top.load(std::memory_order::acquire);
+        circular_array*    a = array.load(std::memory_order::relaxed);
+        if (b - t > static_cast< std::int64_t >(a->capacity()) - 1) { a = grow(a, b, t); }
+        a->put(b, value);
+        bottom.store(b + 1, std::memory_order::release); // the element before the index that makes it visible
+    }
+
+    // Owner only, takes the last pushed element
+    bool try_pop(T& res) {
+        std::int64_t const    b = bottom.load(std::memory_order::relaxed) - 1;
+        circular_array* const a = array.load(std::memory_order::relaxed);
+        bottom.store(b, std::memory_order::relaxed);
+        std::atomic_thread_fence(std::memory_order::seq_cst); // thieves see bottom lowered, or the owner sees their top
+        std::int64_t t = top.load(std::memory_order::relaxed);
+        if (t > b) { // empty
+            bottom.store(b + 1, std::memory_order::relaxed);
+            return false;
+        }
+        res = a->get(b);
+        if (t < b) { return true; }
+        // Last element: thieves may be after it too
+        bool const won = top.compare_exchange_strong(t, t + 1, std::memory_order::seq_cst, std::memory_order::relaxed);
+        bottom.store(b + 1, std::memory_order::relaxed);
+        return won;
+    }
+
+    // Any thread, takes the oldest element. Retries while it loses its CAS to other thieves or to the owner
+    bool try_steal(T& res) {
+        for (;;) {
+            std::int64_t t = top.load(std::memory_order::acquire);
+            std::atomic_thread_fence(std::memory_order::seq_cst);
+            std::int64_t const b = bottom.load(std::memory_order::acquire);
+            if (t >= b) { return false; }
+            res = array.load(std::memory_order::acquire)->get(t);
+            if (top.compare_exchange_strong(t, t + 1, std::memory_order::seq_cst, std::memory_order::relaxed)) { return true; }
+        }
+    }
+
+    // Hints: may be stale as soon as they return
+    bool        empty() const { return size() == 0; }
+    std::size_t size() const {
+        std::int64_t const t = top.load(std::memory_order::relaxed);
+        std::int64_t const b = bottom.load(std::memory_order::relaxed);
+        return b > t ? static_cast< std::size_t >(b - t) : 0;
+    }
+};
+
+// The default local queue of thread_pool_9_8: a chase_lev_deque of pointers to tasks, the owner takes the last task it
+// pushed, like work_stealing_queue_9_7. A thief copies an element before its CAS decides who owns it, so tasks are
+// boxed: the boxes come from the per-thread pools of pooled_node_allocator, and their blocks are recycled.
+class work_stealing_queue_chase_lev {
+  private:
+    using data_type = function_wrapper;
+    using allocator = pooled_node_allocator;
+
+    chase_lev_deque< data_type* > the_queue;
+
+    static void unbox(data_type* box, data_type& res) {
+        res = std::move(*box);
+        allocator::destroy(box);
+    }
+
+  public:
+    work_stealing_queue_chase_lev() {}
+    ~work_stealing_queue_chase_lev() {
+        data_type* box;
+        while (the_queue.try_pop(box)) { allocator::destroy(box); }
+    }
+
+    work_stealing_queue_chase_lev(const work_stealing_queue_chase_lev&) = delete;
+    work_stealing_queue_chase_lev& operator=(const work_stealing_queue_chase_lev&) = delete;
+
+    void        push(data_type&& data) { the_queue.push(allocator::create< data_type >(std::move(data))); }
+    bool        empty() const { return the_queue.empty(); }
+    std::size_t size() const { return the_queue.size(); }
+    bool        try_pop(data_type& res) {
+        data_type* box;
+        if (!the_queue.try_pop(box)) { return false; }
+        unbox(box, res);
+        return true;
+    }
+    bool try_steal(data_type& res) {
+        data_type* box;
+        if (!the_queue.try_steal(box)) { return false; }
+        unbox(box, res);
+        return true;
+    }
+};